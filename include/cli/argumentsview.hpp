@@ -0,0 +1,105 @@
+/*
+ * argumentsview.hpp - Arguments of a command that refer to the command line
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ARGUMENTSVIEW_HPP_
+#define ARGUMENTSVIEW_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli
+{
+    //
+    // Class ArgumentsView
+    //
+    // Words of a command as std::string_view. The words written as is in
+    // the command line refer to it. Only those changed by quote removal or
+    // expansion are copied, to a side buffer of the view. The memory of the
+    // view is kept by assign(), so once it has grown enough to hold the
+    // longest command, filling it again does not allocate.
+    //
+    // The words are not null-terminated. They are valid while the line and
+    // the view are not changed.
+    //
+
+    class ArgumentsView
+    {
+        public:
+            typedef std::string_view WordType;
+
+            //
+            // Start a new command whose words are taken from line
+            //
+
+            void assign(std::string_view line)
+            {
+                line_ = line;
+                buffer_.clear();
+                words_.clear();
+            }
+
+            //
+            // Members to add the words of the command
+            //
+
+            void addFromLine(size_t position, size_t length)
+            {
+                Word word = { false, position, length };
+                words_.push_back(word);
+            }
+
+            void addCopy(std::string_view text)
+            {
+                Word word = { true, buffer_.size(), text.size() };
+                buffer_.append(text);
+                words_.push_back(word);
+            }
+
+            //
+            // Members to read the words of the command
+            //
+
+            size_t size() const
+                { return words_.size(); }
+            bool empty() const
+                { return words_.empty(); }
+
+            WordType operator[](size_t index) const
+            {
+                const Word& word = words_[index];
+                return word.isCopied ?
+                    WordType(buffer_).substr(word.position, word.length) :
+                    line_.substr(word.position, word.length);
+            }
+
+        private:
+            struct Word
+            {
+                bool isCopied;          // In buffer_ instead of line_
+                size_t position;
+                size_t length;
+            };
+
+            std::string_view line_;
+            std::string buffer_;
+            std::vector<Word> words_;
+    };
+}
+
+#endif /* ARGUMENTSVIEW_HPP_ */
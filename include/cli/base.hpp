@@ -26,9 +26,12 @@
 #include <string>
 
 #include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ref.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <cli/callbacks.hpp>
+#include <cli/pipeline.hpp>
 #include <cli/readline.hpp>
 #include <cli/traits.hpp>
 #include <cli/utility.hpp>
@@ -50,6 +53,7 @@ namespace cli
                 CommandArgumentsType;
             typedef typename cli::traits::ParserTraits<Parser>::ErrorType
                 ParseErrorType;
+            typedef cli::Pipeline<CommandArgumentsType> PipelineType;
 
             typedef bool (ParserSignature)(
                 std::string::const_iterator&, std::string::const_iterator,
@@ -85,8 +89,17 @@ namespace cli
             // Members to interpret command-line input
             //
 
+            //
+            // If isLastLine is true, no more input follows the line, so
+            // the last command may replace the interpreter process.
+            // loop() looks one line ahead when the input is a regular file
+            // to know it. Other inputs, like pipes, may not have the next
+            // line until the output of the current one has been read.
+            //
+
             void loop();
-            bool interpretOneLine(std::string line);
+            bool interpretOneLine(const std::string& line,
+                bool isLastLine = false);
 
             //
             // Members to manage the command history
@@ -118,6 +131,38 @@ namespace cli
             cli::callback::PreLoopCallback onPreLoop;
             cli::callback::PostLoopCallback onPostLoop;
 
+        protected:
+
+            //
+            // Accessors of the I/O streams
+            //
+
+            std::ostream& outputStream()
+                { return out_; }
+            std::ostream& errorStream()
+                { return err_; }
+
+            //
+            // Hook method invoked by runPipeline() for every single command
+            //
+
+            virtual bool runCommand(const std::string& command,
+                CommandArgumentsType const& arguments);
+
+            //
+            // True while running the pipeline that ends the input
+            //
+
+            bool isLastPipeline() const
+                { return isLastPipeline_; }
+
+            //
+            // Parser object, if the interpreter was not given a function
+            //
+
+            const boost::shared_ptr<Parser>& parserObject() const
+                { return parserObject_; }
+
         private:
             std::istream& in_;
             std::ostream& out_;
@@ -127,18 +172,69 @@ namespace cli
             std::string introText_;
             std::string promptText_;
             std::string lastCommand_;
+            bool isLastPipeline_;
 
+            // parser_ refers to parserObject_, if any, instead of copying it,
+            // so the state kept by the parser can be reached through it
             boost::shared_ptr<Parser> parserObject_;
             boost::function<ParserSignature> parser_;
 
+            //
+            // Objects where the lines are parsed. They are cleared but not
+            // freed between lines, so the memory they got is reused. The
+            // callbacks of a line that interpret other lines get their own.
+            //
+
+            struct Scratch
+            {
+                std::string line;
+                PipelineType pipeline;
+                ParseErrorType error;
+                bool isInUse;
+
+                Scratch() : isInUse(false) {}
+
+                //
+                // Class Scope
+                //
+                // Marks the scratch as in use while it exists, so it is
+                // released even if the line ends with an exception.
+                //
+
+                class Scope : private boost::noncopyable
+                {
+                    public:
+                        Scope(Scratch& scratch)
+                            : scratch_(scratch)
+                            { scratch_.isInUse = true; }
+                        ~Scope()
+                            { scratch_.isInUse = false; }
+
+                    private:
+                        Scratch& scratch_;
+                };
+            };
+
+            Scratch scratch_;
+
+            bool interpretLine(Scratch& scratch, bool isLastLine);
+
             //
             // Hook methods invoked for command execution
             //
 
-            virtual bool runCommand(const std::string& command,
-                CommandArgumentsType const& arguments);
+            virtual bool runPipeline(const PipelineType& pipeline);
             virtual bool emptyLine();
 
+            //
+            // Hook method to know if the output of the command goes to the
+            // next one in the command line
+            //
+
+            virtual bool isPipedCommand(
+                CommandArgumentsType const& arguments) const
+                { return false; }
+
             //
             // Hook methods invoked inside interpretOneLine()
             //
@@ -164,8 +260,9 @@ namespace cli
           out_(std::cout),
           err_(std::cerr),
           readLine_(useReadline),
+          isLastPipeline_(false),
           parserObject_(new Parser),
-          parser_(*parserObject_)
+          parser_(boost::ref(*parserObject_))
     {}
 
     template <typename Parser>
@@ -176,9 +273,13 @@ namespace cli
           out_(out),
           err_(err),
           readLine_(useReadline),
+          isLastPipeline_(false),
           parserObject_(new Parser),
-          parser_(*parserObject_)
-    {}
+          parser_(boost::ref(*parserObject_))
+    {
+        readLine_.inStream(in);
+        readLine_.outStream(out);
+    }
 
     template <typename Parser>
     CommandLineInterpreterBase<Parser>::CommandLineInterpreterBase(
@@ -187,6 +288,7 @@ namespace cli
           out_(std::cout),
           err_(std::cerr),
           readLine_(useReadline),
+          isLastPipeline_(false),
           parser_(parser)
     {}
 
@@ -198,8 +300,12 @@ namespace cli
           out_(out),
           err_(err),
           readLine_(useReadline),
+          isLastPipeline_(false),
           parser_(parser)
-    {}
+    {
+        readLine_.inStream(in);
+        readLine_.outStream(out);
+    }
 
     template <typename Parser>
     CommandLineInterpreterBase<Parser>::CommandLineInterpreterBase(
@@ -208,8 +314,9 @@ namespace cli
           out_(std::cout),
           err_(std::cerr),
           readLine_(useReadline),
+          isLastPipeline_(false),
           parserObject_(parser),
-          parser_(*parser)
+          parser_(boost::ref(*parser))
     {}
 
     template <typename Parser>
@@ -220,13 +327,18 @@ namespace cli
           out_(out),
           err_(err),
           readLine_(useReadline),
+          isLastPipeline_(false),
           parserObject_(parser),
-          parser_(*parser)
-    {}
+          parser_(boost::ref(*parser))
+    {
+        readLine_.inStream(in);
+        readLine_.outStream(out);
+    }
 
     template <typename Parser>
     void CommandLineInterpreterBase<Parser>::loop()
     {
+        using utility::detail::isStreamRegularFile;
         using utility::detail::isStreamTty;
 
         preLoop();
@@ -237,14 +349,32 @@ namespace cli
             promptText = promptText_;
         }
 
-        std::string line;
-        while (true) {
-            bool isOk = readLine_.readLine(line, promptText);
-            if (! isOk)
-                break;
-            bool isFinished = interpretOneLine(line);
+        // Scripts are read one line ahead, to know which one is the last
+        bool isLookingAhead = isStreamRegularFile(in_);
+
+        std::string line, nextLine;
+        bool isOk = readLine_.readLine(line, promptText);
+        while (isOk) {
+            bool isLastLine = false;
+            if (isLookingAhead) {
+                isOk = readLine_.readLine(nextLine, promptText);
+                isLastLine = ! isOk;
+            }
+            bool isFinished;
+            if (scratch_.isInUse) {
+                isFinished = interpretOneLine(line, isLastLine);
+            }
+            else {
+                // The line is handed over without copying it
+                scratch_.line.swap(line);
+                isFinished = interpretLine(scratch_, isLastLine);
+            }
             if (isFinished)
                 break;
+            if (isLookingAhead)
+                line.swap(nextLine);
+            else
+                isOk = readLine_.readLine(line, promptText);
         }
 
         postLoop();
@@ -252,10 +382,28 @@ namespace cli
 
     template <typename Parser>
     bool CommandLineInterpreterBase<Parser>::interpretOneLine(
-        std::string line)
+        const std::string& line, bool isLastLine)
     {
+        if (scratch_.isInUse) {
+            Scratch scratch;
+            scratch.line = line;
+            return interpretLine(scratch, isLastLine);
+        }
+        scratch_.line = line;
+        return interpretLine(scratch_, isLastLine);
+    }
+
+    template <typename Parser>
+    bool CommandLineInterpreterBase<Parser>::interpretLine(Scratch& scratch,
+        bool isLastLine)
+    {
+        std::string& line = scratch.line;
+        PipelineType& pipeline = scratch.pipeline;
+
+        typename Scratch::Scope scratchScope(scratch);
         preRunCommand(line);
 
+        bool isFinished = false;
         if (utility::detail::isLineEmpty(line)) {
             return emptyLine();
         }
@@ -263,27 +411,36 @@ namespace cli
             lastCommand_ = line;
         }
 
+        // Parsers that overwrite the commands get the previous ones as they
+        // are, to reuse the memory of every word
+        bool isCleared = ! (parserObject_ &&
+            traits::ParserOverwritesArguments<Parser>::value);
+
         std::string::const_iterator begin = line.begin();
         std::string::const_iterator end = line.end();
+        pipeline.clear();
         while (begin != end) {
-            std::string command;
-            CommandArgumentsType arguments;
-            ParseErrorType error;
-            bool success = parser_(begin, end, command, arguments, error);
+            typename PipelineType::Command& command =
+                pipeline.add(isCleared);
+            bool success = parser_(begin, end, command.name,
+                command.arguments, scratch.error);
 
-            bool isFinished;
             if (! success) {
-                isFinished = parseError(error, line);
-                return isFinished;
+                isFinished = parseError(scratch.error, line);
+                break;
             }
-            else {
-                isFinished = runCommand(command, arguments);
+            else if (! isPipedCommand(command.arguments) || begin == end) {
+                // The whole pipeline is parsed before any command runs
+                isLastPipeline_ = isLastLine && begin == end;
+                isFinished = runPipeline(pipeline);
+                isLastPipeline_ = false;
                 isFinished = postRunCommand(isFinished, line);
                 if (isFinished)
-                    return true;
+                    break;
+                pipeline.clear();
             }
         }
-        return false;
+        return isFinished;
     }
 
     template <typename Parser>
@@ -298,7 +455,21 @@ namespace cli
     bool CommandLineInterpreterBase<Parser>::runCommand(
         const std::string& command, CommandArgumentsType const& arguments)
     {
-        return onRunCommand ? onRunCommand.call(command, arguments) : false;
+        return onRunCommand.isDefined(command) ?
+            onRunCommand.call(command, arguments) : false;
+    }
+
+    template <typename Parser>
+    bool CommandLineInterpreterBase<Parser>::runPipeline(
+        const PipelineType& pipeline)
+    {
+        bool isFinished = false;
+        for (typename PipelineType::CommandsType::const_iterator i =
+            pipeline.commands().begin(); i < pipeline.commands().end(); ++i)
+        {
+            isFinished = runCommand(i->name, i->arguments) || isFinished;
+        }
+        return isFinished;
     }
 
     template <typename Parser>
@@ -22,22 +22,31 @@
 #include <iostream>
 #include <string>
 
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/spirit/include/phoenix_bind.hpp>
+#include <boost/spirit/include/phoenix_container.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/qi_expect.hpp>
 
 #include <cli/base.hpp>
+#include <cli/parsearena.hpp>
+#include <cli/parsecache.hpp>
+#include <cli/traits.hpp>
 
 #define translate(str) str  // TODO: Use Boost.Locale when available
 
 namespace cli { namespace parser { namespace spiritparser
 {
     namespace qi = boost::spirit::qi;
+    namespace phoenix = boost::phoenix;
 
     //
     // Class SpiritParseError
     //
-    // Type used to return parse errors to the interpreter.
+    // Type used to return parse errors to the interpreter. It only keeps
+    // where the error was found and what was expected there, so the
+    // message is not built until what() is called.
     //
 
     struct SpiritParseError
@@ -48,11 +57,12 @@ namespace cli { namespace parser { namespace spiritparser
 
         SpiritParseError();
         SpiritParseError(const std::string& what);
+        SpiritParseError(std::string::const_iterator first,
+            std::string::const_iterator last, const char* expected);
         SpiritParseError(
             const qi::expectation_failure<std::string::const_iterator>& e);
 
-        const std::string& what() const
-            { return what_; }
+        const std::string& what() const;
 
         //
         // These attributes will only contains valid values if
@@ -65,21 +75,172 @@ namespace cli { namespace parser { namespace spiritparser
             { return expectationFailureFirst_; }
         const std::string::const_iterator& expectationFailureLast() const
             { return expectationFailureLast_; }
-        const boost::spirit::info& expectationFailureWhat() const
-            { return expectationFailureWhat_; }
+        boost::spirit::info expectationFailureWhat() const;
 
         bool hasExpectationFailure() const
             { return expectationFailure_; }
 
         private:
-            std::string what_;
+            mutable std::string what_;
 
             std::string::const_iterator expectationFailureFirst_;
             std::string::const_iterator expectationFailureLast_;
+            const char* expected_;      // Set if the grammar did not throw
             boost::spirit::info expectationFailureWhat_;
             bool expectationFailure_;
     };
 
+    //
+    // Class ExpectationTracker
+    //
+    // Base class for grammars that report expectation failures without
+    // throwing qi::expectation_failure. Instead of a > b their rules say
+    // a >> (b | expected(what)), so when b does not match the position and
+    // the name of what was expected are recorded and the parser fails.
+    // Only the first failure is kept, and BasicSpiritParser reports it even
+    // if the grammar finds another way to match the line.
+    //
+
+    template <typename Iterator>
+    class ExpectationTracker : private boost::noncopyable
+    {
+        public:
+
+            struct ExpectationFailure
+            {
+                Iterator first;
+                Iterator last;
+                const char* what;       // NULL if nothing has failed
+            };
+
+            ExpectationTracker();
+
+            bool hasExpectationFailure() const
+                { return failure_.what != NULL; }
+            const ExpectationFailure& expectationFailure() const
+                { return failure_; }
+
+            //
+            // Record that what was expected at first. The text that could
+            // not be parsed goes up to last or, if it is not given, up to the
+            // end of the line.
+            //
+
+            void expectationFailure(Iterator first, const char* what)
+                { expectationFailure(first, end_, what); }
+            void expectationFailure(Iterator first, Iterator last,
+                const char* what)
+            {
+                if (failure_.what == NULL) {
+                    failure_.first = first;
+                    failure_.last = last;
+                    failure_.what = what;
+                }
+            }
+
+            //
+            // Class Scope
+            //
+            // Clears the failures while a line, that ends at end, is parsed.
+            // Those of the enclosing line, if a command is parsed from a
+            // callback of another one, are restored when it ends. The
+            // tracker may be NULL.
+            //
+
+            class Scope : private boost::noncopyable
+            {
+                public:
+                    Scope(ExpectationTracker* tracker, Iterator end)
+                        : tracker_(tracker)
+                    {
+                        if (tracker_ != NULL) {
+                            previousFailure_ = tracker_->failure_;
+                            previousEnd_ = tracker_->end_;
+                            tracker_->failure_.what = NULL;
+                            tracker_->end_ = end;
+                        }
+                    }
+
+                    ~Scope()
+                    {
+                        if (tracker_ != NULL) {
+                            tracker_->failure_ = previousFailure_;
+                            tracker_->end_ = previousEnd_;
+                        }
+                    }
+
+                private:
+                    ExpectationTracker* tracker_;
+                    ExpectationFailure previousFailure_;
+                    Iterator previousEnd_;
+            };
+
+        protected:
+            typedef typename boost::proto::terminal<
+                qi::parameterized_nonterminal<
+                    qi::rule<Iterator, void(const char*)>,
+                    boost::fusion::vector<const char*> > >::type
+                ExpectedParserType;
+
+            ExpectedParserType expected(const char* what) const
+                { return expected_(what); }
+
+        private:
+            ExpectationFailure failure_;
+            Iterator end_;
+
+            qi::rule<Iterator, void(const char*)> expected_;
+    };
+
+    template <typename Iterator>
+    ExpectationTracker<Iterator>::ExpectationTracker()
+    {
+        void (ExpectationTracker::*record)(Iterator, const char*) =
+            &ExpectationTracker::expectationFailure;
+
+        failure_.what = NULL;
+        expected_ = qi::raw[qi::eps] [phoenix::bind(record, this,
+            phoenix::begin(qi::_1), qi::_r1)] >> !qi::eps;
+    }
+
+    //
+    // Class FastPath
+    //
+    // Grammars may specialize it to parse the most common command lines
+    // without Boost.Spirit. parse() has to return false, leaving begin,
+    // command and arguments untouched, when the line needs the full
+    // grammar. Otherwise, it has to replace command and arguments, that
+    // may keep the values of a previous command.
+    //
+
+    template <typename Grammar>
+    struct FastPath
+    {
+        template <typename Iterator, typename Arguments>
+        static bool parse(Grammar& grammar, Iterator& begin, Iterator end,
+            std::string& command, Arguments& arguments)
+            { return false; }
+    };
+
+    //
+    // Class ParseCachePolicy
+    //
+    // Grammars may specialize it to let BasicSpiritParser keep the commands
+    // parsed in a ParseCache. isEnabled() tells whether the cache can be
+    // used at all, and isCacheable() whether the command just parsed would
+    // be the same if the text were parsed again. By default nothing is
+    // cached.
+    //
+
+    template <typename Grammar>
+    struct ParseCachePolicy
+    {
+        static bool isEnabled(const Grammar& grammar)
+            { return false; }
+        static bool isCacheable(const Grammar& grammar)
+            { return false; }
+    };
+
     //
     // Class BasicSpiritParser
     //
@@ -92,6 +253,7 @@ namespace cli { namespace parser { namespace spiritparser
         public:
             typedef BasicSpiritParser<Arguments, Grammar> Type;
             typedef Grammar<std::string::const_iterator> GrammarType;
+            typedef ParseCache<Arguments> ParseCacheType;
 
             BasicSpiritParser()
                 : grammar_(new GrammarType)
@@ -105,18 +267,66 @@ namespace cli { namespace parser { namespace spiritparser
                 std::string::const_iterator end, std::string& command,
                 Arguments& arguments, SpiritParseError& error)
             {
+                if (FastPath<GrammarType>::parse(*grammar_, begin, end,
+                    command, arguments)) {
+                    return true;
+                }
+
+                // Repeated lines are taken from the cache, keyed by the
+                // text left to parse
+                bool isCacheEnabled = parseCache_.capacity() > 0 &&
+                    ParseCachePolicy<GrammarType>::isEnabled(*grammar_);
+                if (isCacheEnabled) {
+                    cacheKey_.assign(begin, end);
+                    const typename ParseCacheType::Entry* entry =
+                        parseCache_.find(cacheKey_);
+                    if (entry != NULL) {
+                        command = entry->command;
+                        arguments = entry->arguments;
+                        begin += entry->length;
+                        return true;
+                    }
+                }
+
                 // Passing the attributes 'command' and 'arguments' to the
                 // parser forces that every valid grammar must return a
-                // two-references Sequence.
+                // two-references Sequence. Grammars may add to them, so they
+                // are emptied first.
+                command.clear();
+                arguments.clear();
+
+                // The attributes that grammars use in the meantime may take
+                // their memory from the arena, with ParseAllocator
+                ParseArena::Scope arenaScope(arena_);
+                ExpectationTrackerType* tracker =
+                    expectationTracker(grammar_.get());
+                typename ExpectationTrackerType::Scope expectationScope(
+                    tracker, end);
                 try {
+                    std::string::const_iterator first = begin;
                     bool success = qi::phrase_parse(begin, end, *grammar_,
                         skipper_, command, arguments);
+                    if (tracker != NULL && tracker->hasExpectationFailure()) {
+                        const typename ExpectationTrackerType::
+                            ExpectationFailure& failure =
+                                tracker->expectationFailure();
+                        error = SpiritParseError(failure.first,
+                            failure.last, failure.what);
+                        return false;
+                    }
                     if (success) {
+                        if (isCacheEnabled && ParseCachePolicy<
+                            GrammarType>::isCacheable(*grammar_)) {
+                            parseCache_.insert(cacheKey_, begin - first,
+                                command, arguments);
+                        }
                         return true;
                     }
-                    error = SpiritParseError(translate("syntax error"));
+                    error = SpiritParseError();
                     return false;
                 }
+                // Grammars that do not derive from ExpectationTracker may
+                // still throw
                 catch (const qi::expectation_failure<
                     std::string::const_iterator>& e)
                 {
@@ -125,11 +335,26 @@ namespace cli { namespace parser { namespace spiritparser
                 }
             }
 
+            ParseCacheType& parseCache()
+                { return parseCache_; }
+
         private:
+            typedef ExpectationTracker<std::string::const_iterator>
+                ExpectationTrackerType;
+
             typename GrammarType::skipper_type skipper_;
 
             boost::shared_ptr<GrammarType> grammar_;
+            ParseCacheType parseCache_;
+            ParseArena arena_;
+            std::string cacheKey_;      // Reused to not allocate every time
             SpiritParseError parseError_;
+
+            static ExpectationTrackerType* expectationTracker(
+                ExpectationTrackerType* grammar)
+                { return grammar; }
+            static ExpectationTrackerType* expectationTracker(...)
+                { return NULL; }
     };
 }}}
 
@@ -137,6 +362,16 @@ namespace cli
 {
     using namespace cli::parser::spiritparser;
 
+    namespace traits
+    {
+        template <typename Arguments, template <typename> class Grammar>
+        struct ParserOverwritesArguments<
+            parser::spiritparser::BasicSpiritParser<Arguments, Grammar> >
+        {
+            static const bool value = true;
+        };
+    }
+
     //
     // Class BasicSpiritInterpreter
     //
@@ -153,6 +388,7 @@ namespace cli
         typedef typename SpiritParserType::GrammarType SpiritGrammarType;
 
         typedef CommandLineInterpreterBase<SpiritParserType> BaseType;
+        typedef typename SpiritParserType::ParseCacheType ParseCacheType;
 
         BasicSpiritInterpreter(bool useReadline = true)
             : BaseType(useReadline)
@@ -175,6 +411,14 @@ namespace cli
             : BaseType(boost::shared_ptr<SpiritParserType>(
                 new SpiritParserType(grammar)), in, out, err, useReadline)
         {}
+
+        //
+        // Cache of the commands parsed from repeated lines, if the grammar
+        // allows it. Its capacity can be changed or set to 0 to disable it.
+        //
+
+        ParseCacheType& parseCache()
+            { return this->parserObject()->parseCache(); }
     };
 }
 
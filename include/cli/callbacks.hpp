@@ -21,6 +21,7 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 
 #include <boost/function.hpp>
@@ -79,16 +80,44 @@ namespace cli { namespace callback
                 }
             }
 
+            //
+            // Check if there is a callback to run the command, either
+            // registered for its name or the default one
+            //
+
+            bool isDefined(const std::string& command) const
+            {
+                return callbacks_.find(command) != callbacks_.end() ||
+                    BaseType::operator bool();
+            }
+
+            //
+            // Check if the callback of the command was registered as a
+            // builtin. Builtins are run by the interpreter itself, even when
+            // their standard I/O has to be redirected.
+            //
+
+            bool isBuiltin(const std::string& command) const
+                { return builtins_.find(command) != builtins_.end(); }
+
             using BaseType::operator();
 
             void operator()(const std::string& command,
-                boost::function<Signature> const& callback)
+                boost::function<Signature> const& callback,
+                bool isBuiltin = false)
             {
                 callbacks_[command] = callback;
+                if (isBuiltin) {
+                    builtins_.insert(command);
+                }
+                else {
+                    builtins_.erase(command);
+                }
             }
 
         private:
             std::map<std::string, boost::function<Signature> > callbacks_;
+            std::set<std::string> builtins_;
     };
 
     template <typename Parser>
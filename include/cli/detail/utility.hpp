@@ -28,6 +28,7 @@ namespace cli { namespace utility { namespace detail
 {
     bool isLineEmpty(const std::string& line);
     bool isStreamTty(const std::ios& stream);
+    bool isStreamRegularFile(const std::ios& stream);
 
 }}}
 
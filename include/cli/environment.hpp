@@ -0,0 +1,78 @@
+/*
+ * environment.hpp - Environment of the programs launched by an interpreter
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ENVIRONMENT_HPP_
+#define ENVIRONMENT_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cli { namespace launcher
+{
+    //
+    // Class Environment
+    //
+    // Builds the envp of a single command: the variables exported by the
+    // process plus the assignments given on its command line, which hide
+    // the exported variables with the same name. The environ of the
+    // process is not modified.
+    //
+    // The exported variables are indexed once and the index is only rebuilt
+    // when environ changes, so the cost of a command with assignments does
+    // not depend on how many of them have to be looked up.
+    //
+
+    class Environment
+    {
+        public:
+
+            //
+            // Members to set the assignments of the next command
+            //
+
+            void set(const std::string& name, const std::string& value);
+            void clear()
+                { assignments_.clear(); }
+
+            bool empty() const
+                { return assignments_.empty(); }
+
+            //
+            // Get the envp of the command. Returns NULL if it is the environ
+            // of the process. The array is valid until the next call to any
+            // member of the class.
+            //
+
+            char* const* envp();
+
+        private:
+            typedef std::map<std::string, size_t> IndexType;
+
+            std::vector<char*> snapshot_;       // Copy of environ
+            IndexType index_;                   // Position of every name
+                                                // in snapshot_
+
+            std::vector<std::string> assignments_;
+            std::vector<char*> envp_;
+
+            void update();
+    };
+}}
+
+#endif /* ENVIRONMENT_HPP_ */
@@ -87,6 +87,23 @@ namespace glob
 
             static std::string escape(const std::string& pattern);
 
+            template <typename String>
+            static void appendEscaped(String& escaped, const char* first,
+                const char* last);
+
+            //
+            // Check whether glob() may expand pattern to something else than
+            // itself when called with flags: if it has unescaped meta
+            // characters, braces or a leading tilde for the flags that expand
+            // them. Escaped characters count as well, because glob() would
+            // remove the escape character.
+            //
+
+            static bool isPattern(const char* pattern,
+                GlobFlags flags = NONE);
+            static bool isPattern(const std::string& pattern,
+                GlobFlags flags = NONE);
+
         private:
              ErrorsType errors_;
 
@@ -163,6 +180,24 @@ namespace glob
     {
         return Glob::GlobFlags(~static_cast<int>(a));
     }
+
+    template <typename String>
+    void Glob::appendEscaped(String& escaped, const char* first,
+        const char* last)
+    {
+        for (const char* i = first; i < last; ++i) {
+            switch (*i) {
+            case '~':   // EXPAND_TILDE
+            case '*':
+            case '?':
+            case '[':
+            case '\\':
+                escaped.push_back('\\');
+            default:
+                escaped.push_back(*i);
+            }
+        }
+    }
 }
 
 #endif /* GLOB_HPP_ */
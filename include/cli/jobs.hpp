@@ -0,0 +1,186 @@
+/*
+ * jobs.hpp - Table of the jobs started by an interpreter
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JOBS_HPP_
+#define JOBS_HPP_
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace cli { namespace jobs
+{
+    //
+    // Class Job
+    //
+    // A job is the set of processes started from a single pipeline.
+    //
+
+    struct Job
+    {
+        enum State
+        {
+            RUNNING,
+            STOPPED,
+            DONE
+        };
+
+        struct Process
+        {
+            pid_t pid;
+            State state;
+            int status;             // As returned by waitpid()
+            int pidFd;              // pidfd_open() descriptor, -1 once the
+                                    // process is reaped or if unsupported
+            struct rusage usage;    // As returned by wait4() when it exits
+            struct timespec endTime;
+        };
+
+        int id;
+        pid_t processGroup;         // -1 if the job shares the group of the
+                                    // interpreter
+        std::vector<Process> processes;
+        State state;
+        int status;                 // Status of the last process
+        struct timespec startTime;
+        std::string commandLine;
+        std::string placement;      // CPUs, nice value and policy set when
+                                    // it was launched, if any
+        bool isBackground;
+
+        pid_t pid() const
+            { return processes.empty() ? -1 : processes.back().pid; }
+    };
+
+    //
+    // Class JobTable
+    //
+    // Children are reaped as soon as the interpreter looks at the table,
+    // driven by a signalfd() on SIGCHLD instead of polling waitpid() after
+    // every command. Only the processes of the jobs are waited for, so the
+    // host application can still reap its own children. SIGCHLD is blocked
+    // while the table exists, so launchers must restore savedSignalMask()
+    // in the children.
+    //
+    // If the interpreter is interactive, the table does job control: every
+    // job gets its own process group and the terminal is handed to the job
+    // in the foreground.
+    //
+    // Every process is also tracked by a pidfd where supported. Signals are
+    // sent through it, so they never reach a process that reused the PID,
+    // and waits poll the pidfds of the processes of interest together,
+    // reaping only the ones that are ready.
+    //
+
+    class JobTable : private boost::noncopyable
+    {
+        public:
+            typedef std::map<int, Job> JobsType;
+
+            JobTable();
+            ~JobTable();
+
+            //
+            // Members to register new jobs
+            //
+
+            Job& add(pid_t pid, pid_t processGroup,
+                const std::string& commandLine, bool isBackground = false);
+            void addProcess(Job& job, pid_t pid,
+                const std::string& commandLine);
+
+            //
+            // Members to look for jobs
+            //
+
+            Job* find(int id);
+            Job* findByPid(pid_t pid);
+            Job* current();
+
+            const JobsType& jobs() const
+                { return jobs_; }
+
+            //
+            // Members to control the jobs
+            //
+
+            void update();
+            int wait(Job& job);
+            Job* waitAny();
+            bool waitForChanges();
+            int foreground(Job& job, bool resume = false,
+                Job* finished = NULL);
+            void background(Job& job);
+            void remove(Job& job);
+
+            //
+            // Send a signal to every process of the job, or to a single
+            // process. Return 0 or the errno value of the failure.
+            //
+
+            int signal(Job& job, int signum);
+            int signal(pid_t pid, int signum);
+
+            //
+            // Report the background jobs that have finished since the last
+            // call. They are removed from the table.
+            //
+
+            std::vector<Job> takeFinished();
+
+            bool isJobControlEnabled() const
+                { return terminal_ >= 0; }
+
+            const sigset_t& savedSignalMask() const
+                { return savedSignalMask_; }
+
+            int fileDescriptor() const
+                { return signalFd_; }
+
+        private:
+            JobsType jobs_;
+
+            int signalFd_;
+            sigset_t savedSignalMask_;
+
+            int terminal_;
+            pid_t interpreterProcessGroup_;
+
+            void processStatus(pid_t pid, int status,
+                const struct rusage& usage);
+            void waitForChanges(const std::vector<Job*>& jobs);
+            Job::Process* findProcess(pid_t pid);
+            void continueJob(Job& job);
+            void terminal(pid_t processGroup);
+    };
+
+    //
+    // Functions to show jobs
+    //
+
+    const char* stateToString(const Job& job);
+}}
+
+#endif /* JOBS_HPP_ */
@@ -0,0 +1,333 @@
+/*
+ * launcher.hpp - Launch external programs without copying the address space
+ *                of the calling process when it can be avoided
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LAUNCHER_HPP_
+#define LAUNCHER_HPP_
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include <cli/detail/utility.hpp>
+
+namespace cli { namespace launcher
+{
+    //
+    // Class FileActions
+    //
+    // Ordered list of operations over file descriptors that the child
+    // process has to do before running the new program. It mimics the
+    // posix_spawn_file_actions_t interface, so every backend can apply it.
+    //
+
+    class FileActions
+    {
+        public:
+
+            enum TypeOfAction
+            {
+                OPEN,               // open path and move it to fd
+                DUP2,               // dup2(fd, newFd)
+                CLOSE               // close(fd)
+            };
+
+            struct Action
+            {
+                TypeOfAction type;
+                int fd;
+                int newFd;
+                std::string path;
+                int flags;
+                mode_t mode;
+            };
+
+            typedef std::vector<Action> ActionsType;
+
+            void addOpen(int fd, const std::string& path, int flags,
+                mode_t mode = 0666);
+            void addDup2(int fd, int newFd);
+            void addClose(int fd);
+
+            void clear()
+                { actions_.clear(); }
+
+            bool empty() const
+                { return actions_.empty(); }
+
+            const ActionsType& actions() const
+                { return actions_; }
+
+        private:
+            ActionsType actions_;
+    };
+
+    //
+    // Apply the file actions to the calling process. It only uses
+    // async-signal-safe functions, so it can be called in a child sharing
+    // the memory of the parent. Returns 0 or the errno value of the first
+    // operation that failed.
+    //
+
+    int applyFileActions(const FileActions& fileActions);
+
+    //
+    // Class Placement
+    //
+    // How the scheduler has to treat a new process: the CPUs where it may
+    // run, its nice value and its scheduling policy. What is not set is
+    // inherited from the parent.
+    //
+
+    struct Placement
+    {
+        std::vector<int> cpus;      // Empty to inherit the affinity
+        bool isNicenessSet;
+        int niceness;
+        int policy;                 // SCHED_OTHER, SCHED_BATCH, SCHED_IDLE
+                                    // or -1 to inherit it
+
+        Placement() : isNicenessSet(false), niceness(0), policy(-1) {}
+
+        bool empty() const
+            { return cpus.empty() && ! isNicenessSet && policy < 0; }
+
+        //
+        // Conversions from and to the syntax of taskset, nice and chrt: CPU
+        // lists like 0-3,8, nice values from -20 to 19 and the names other,
+        // batch and idle
+        //
+
+        static bool stringToCpus(const std::string& list,
+            std::vector<int>& cpus);
+        static bool stringToNiceness(const std::string& value,
+            int& niceness);
+        static bool stringToPolicy(const std::string& name, int& policy);
+        static const char* policyToString(int policy);
+
+        std::string toString() const;
+    };
+
+    //
+    // Apply the placement to the calling process. Like applyFileActions(),
+    // it is safe to call in a child sharing the memory of the parent.
+    // Returns 0 or the errno value of the first operation that failed.
+    //
+
+    int applyPlacement(const Placement& placement);
+
+    //
+    // Sort CPUs so the ones that share a core, and then a package, are
+    // next to each other, according to the topology shown in sysfs.
+    // Repeated CPUs are removed.
+    //
+
+    void sortCpusBySiblings(std::vector<int>& cpus);
+
+    //
+    // Class SpawnRequest
+    //
+    // Everything a launcher needs to start a new process.
+    //
+
+    struct SpawnRequest
+    {
+        // Program arguments. The program is searched for in the PATH unless
+        // path is given.
+        std::vector<std::string> arguments;
+        std::string path;
+
+        // Environment of the program, or NULL to use environ
+        char* const* environment;
+
+        FileActions fileActions;
+
+        // Process group of the child: -1 to inherit it from the parent, 0 to
+        // put it in a new group whose leader is the child itself.
+        pid_t processGroup;
+
+        // Close every descriptor but 0, 1, 2 and the ones set up by
+        // fileActions, even those opened without O_CLOEXEC by the caller
+        bool closeDescriptors;
+
+        Placement placement;
+
+        // Function to invoke in the child after applying fileActions and
+        // before calling exec(). If arguments is empty the child exits with
+        // status 0 when it returns.
+        boost::function<void ()> childHook;
+
+        SpawnRequest()
+            : environment(NULL), processGroup(-1), closeDescriptors(true) {}
+    };
+
+    //
+    // Class Launcher
+    //
+    // Base class of every spawn backend. Requests with a childHook, or
+    // without a program to run, always use fork() because they need to run
+    // arbitrary code in a copy of the parent.
+    //
+
+    class Launcher
+    {
+        public:
+
+            enum Backend
+            {
+                FORK,               // fork() + exec()
+                POSIX_SPAWN,        // posix_spawnp()
+                VFORK,              // clone(CLONE_VM | CLONE_VFORK) + exec()
+                FORK_SERVER         // fork() + exec() in a helper process
+            };
+
+            static boost::shared_ptr<Launcher> create(Backend backend);
+
+            static bool stringToBackend(const std::string& name,
+                Backend& backend);
+            static const char* backendToString(Backend backend);
+
+            Launcher();
+            virtual ~Launcher() {};
+
+            virtual Backend backend() const = 0;
+
+            //
+            // Start the process described by request. Returns the PID of the
+            // child or -1 if it could not be started. In such case
+            // lastError() tells why.
+            //
+
+            pid_t spawn(const SpawnRequest& request);
+
+            //
+            // Replace the calling process by the program described by
+            // request, without starting a new one. processGroup and
+            // childHook are ignored. It only returns if the program could
+            // not be run, with -1 and lastError() telling why. Then the file
+            // actions may have been applied to the calling process.
+            //
+
+            int exec(const SpawnRequest& request);
+
+            //
+            // Signal mask of the children. By default, the mask of the
+            // calling thread when the launcher was created.
+            //
+
+            const sigset_t& childSignalMask() const
+                { return childSignalMask_; }
+            void childSignalMask(const sigset_t& mask)
+                { childSignalMask_ = mask; }
+
+            //
+            // Error handling
+            //
+
+            std::error_code lastError() const
+                { return errorCode_; }
+
+        protected:
+            std::error_code errorCode_;
+            sigset_t childSignalMask_;
+
+            pid_t forkAndExec(const SpawnRequest& request);
+
+        private:
+            virtual pid_t doSpawn(const SpawnRequest& request) = 0;
+    };
+
+    class ForkLauncher : public Launcher
+    {
+        public:
+            virtual Backend backend() const
+                { return FORK; }
+
+        private:
+            virtual pid_t doSpawn(const SpawnRequest& request)
+                { return forkAndExec(request); }
+    };
+
+    class PosixSpawnLauncher : public Launcher
+    {
+        public:
+            virtual Backend backend() const
+                { return POSIX_SPAWN; }
+
+        private:
+            virtual pid_t doSpawn(const SpawnRequest& request);
+    };
+
+    //
+    // Class VforkLauncher
+    //
+    // The child shares the memory of the parent until it calls exec(). It
+    // runs on a stack of its own, allocated for every request with room
+    // for its arguments.
+    //
+
+    class VforkLauncher : public Launcher
+    {
+        public:
+            virtual Backend backend() const
+                { return VFORK; }
+
+        private:
+            virtual pid_t doSpawn(const SpawnRequest& request);
+    };
+
+    //
+    // Class ForkServerLauncher
+    //
+    // A small server process is forked when the launcher is created, so it
+    // should be created before the host application grows. Every request is
+    // sent to the server through a socketpair(): the arguments, the
+    // environment, the working directory and, as SCM_RIGHTS, the standard
+    // I/O and the descriptors referenced by the file actions. The server
+    // starts the children with clone(CLONE_PARENT), so they are children of
+    // the process that owns the launcher and the time to spawn them does not
+    // depend on the size of its address space.
+    //
+    // If the server dies, requests are served with fork() + exec().
+    //
+
+    class ForkServerLauncher : public Launcher, private boost::noncopyable
+    {
+        public:
+            ForkServerLauncher();
+            virtual ~ForkServerLauncher();
+
+            virtual Backend backend() const
+                { return FORK_SERVER; }
+
+        private:
+            int socket_;
+            pid_t serverPid_;
+
+            virtual pid_t doSpawn(const SpawnRequest& request);
+            void stopServer();
+    };
+}}
+
+#endif /* LAUNCHER_HPP_ */
@@ -0,0 +1,120 @@
+/*
+ * parsearena.hpp - Memory for the temporary objects built by the parsers
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PARSEARENA_HPP_
+#define PARSEARENA_HPP_
+
+#include <memory_resource>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+namespace cli { namespace parser
+{
+    //
+    // Class ParseArena
+    //
+    // Memory for the objects that only live while a command is parsed. It
+    // is handed out with a pointer bump from a buffer inside the arena, and
+    // released all at once when the parse ends. Only commands that need
+    // more get extra memory from operator new.
+    //
+
+    class ParseArena : private boost::noncopyable
+    {
+        public:
+            ParseArena();
+
+            std::pmr::memory_resource* resource()
+                { return &resource_; }
+
+            //
+            // Class Scope
+            //
+            // While it exists, the containers that use ParseAllocator and
+            // are created by the calling thread take their memory from the
+            // arena. The memory is released when the last scope of the arena
+            // ends, so a command parsed from a callback of another one shares
+            // it with that one.
+            //
+
+            class Scope : private boost::noncopyable
+            {
+                public:
+                    Scope(ParseArena& arena);
+                    ~Scope();
+
+                private:
+                    ParseArena& arena_;
+                    std::pmr::memory_resource* previous_;
+            };
+
+            //
+            // Resource of the innermost scope of the calling thread, or the
+            // one that uses operator new if there is none
+            //
+
+            static std::pmr::memory_resource* current();
+
+        private:
+            char buffer_[4096];
+            std::pmr::monotonic_buffer_resource resource_;
+            unsigned scopes_;
+    };
+
+    //
+    // Class ParseAllocator
+    //
+    // Allocator that takes the memory of the current ParseArena. Copies of
+    // containers take it from the arena that is current when they are made.
+    //
+
+    template <typename T>
+    class ParseAllocator : public std::pmr::polymorphic_allocator<T>
+    {
+        public:
+            typedef std::pmr::polymorphic_allocator<T> BaseType;
+
+            template <typename U>
+            struct rebind
+            {
+                typedef ParseAllocator<U> other;
+            };
+
+            ParseAllocator()
+                : BaseType(ParseArena::current())
+            {}
+
+            ParseAllocator(std::pmr::memory_resource* resource)
+                : BaseType(resource)
+            {}
+
+            template <typename U>
+            ParseAllocator(const ParseAllocator<U>& other)
+                : BaseType(other.resource())
+            {}
+
+            ParseAllocator select_on_container_copy_construction() const
+                { return ParseAllocator(); }
+    };
+
+    typedef std::basic_string<char, std::char_traits<char>,
+        ParseAllocator<char> > ParseString;
+}}
+
+#endif /* PARSEARENA_HPP_ */
@@ -0,0 +1,148 @@
+/*
+ * parsecache.hpp - Cache of the commands parsed from repeated lines
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PARSECACHE_HPP_
+#define PARSECACHE_HPP_
+
+#include <list>
+#include <string>
+
+#include <boost/unordered_map.hpp>
+
+namespace cli { namespace parser
+{
+    //
+    // Class ParseCache
+    //
+    // Remembers the command parsed from the text that was left in a line,
+    // together with how many characters it took, so scripts that repeat
+    // the same lines do not parse them again. When it is full, the entry
+    // used least recently is dropped. A capacity of 0 disables it.
+    //
+
+    template <typename Arguments>
+    class ParseCache
+    {
+        public:
+
+            struct Entry
+            {
+                std::string text;
+                size_t length;          // Characters of text parsed
+                std::string command;
+                Arguments arguments;
+            };
+
+            typedef std::list<Entry> EntriesType;
+
+            ParseCache(size_t capacity = 256)
+                : capacity_(capacity), hits_(0), misses_(0)
+            {}
+
+            //
+            // Look for the command parsed from text. Returns NULL and counts
+            // a miss if it is not in the cache.
+            //
+
+            const Entry* find(const std::string& text)
+            {
+                typename IndexType::iterator i = index_.find(text);
+                if (i == index_.end()) {
+                    ++misses_;
+                    return NULL;
+                }
+                ++hits_;
+                entries_.splice(entries_.begin(), entries_, i->second);
+                return &*i->second;
+            }
+
+            void insert(const std::string& text, size_t length,
+                const std::string& command, const Arguments& arguments)
+            {
+                if (capacity_ == 0 || index_.find(text) != index_.end()) {
+                    return;
+                }
+                if (entries_.size() >= capacity_) {
+                    index_.erase(entries_.back().text);
+                    entries_.pop_back();
+                }
+                entries_.push_front(Entry());
+                Entry& entry = entries_.front();
+                entry.text = text;
+                entry.length = length;
+                entry.command = command;
+                entry.arguments = arguments;
+                index_[entry.text] = entries_.begin();
+            }
+
+            //
+            // Cache management
+            //
+
+            size_t capacity() const
+                { return capacity_; }
+            void capacity(size_t capacity)
+            {
+                capacity_ = capacity;
+                while (entries_.size() > capacity_) {
+                    index_.erase(entries_.back().text);
+                    entries_.pop_back();
+                }
+            }
+
+            void clear()
+            {
+                entries_.clear();
+                index_.clear();
+            }
+
+            bool empty() const
+                { return entries_.empty(); }
+            size_t size() const
+                { return entries_.size(); }
+
+            // Most recently used first
+            const EntriesType& entries() const
+                { return entries_; }
+
+            //
+            // Statistics
+            //
+
+            unsigned long hits() const
+                { return hits_; }
+            unsigned long misses() const
+                { return misses_; }
+
+            void resetStatistics()
+                { hits_ = misses_ = 0; }
+
+        private:
+            typedef boost::unordered_map<std::string,
+                typename EntriesType::iterator> IndexType;
+
+            size_t capacity_;
+            EntriesType entries_;
+            IndexType index_;
+
+            unsigned long hits_;
+            unsigned long misses_;
+    };
+}}
+
+#endif /* PARSECACHE_HPP_ */
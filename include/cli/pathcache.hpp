@@ -0,0 +1,98 @@
+/*
+ * pathcache.hpp - Cache of the location of programs found in the PATH
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PATHCACHE_HPP_
+#define PATHCACHE_HPP_
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cli { namespace launcher
+{
+    //
+    // Class PathCache
+    //
+    // Maps command names to the absolute path of the program that execvp()
+    // would run. Misses are remembered too, so a mistyped command does not
+    // walk the PATH again. Every entry is checked against the modification
+    // time of the PATH directories searched to find it, and the whole cache
+    // is dropped when the PATH variable changes.
+    //
+
+    class PathCache
+    {
+        public:
+
+            struct Entry
+            {
+                std::string path;       // Empty if the command was not found
+                unsigned hits;
+                size_t searched;        // Number of PATH directories that
+                                        // were searched to resolve it
+            };
+
+            typedef std::map<std::string, Entry> EntriesType;
+
+            //
+            // Find the program to run for name. Returns false if it is not in
+            // the PATH. Names containing a slash are returned unchanged.
+            //
+
+            bool lookup(const std::string& name, std::string& path);
+
+            //
+            // Find the program to run for name in the directories listed in
+            // pathVariable, without using any cache. It is meant for
+            // commands that set their own PATH.
+            //
+
+            static bool lookup(const std::string& name,
+                const std::string& pathVariable, std::string& path);
+
+            //
+            // Cache management
+            //
+
+            void forget(const std::string& name)
+                { entries_.erase(name); }
+            void clear();
+
+            const EntriesType& entries() const
+                { return entries_; }
+
+        private:
+
+            struct Directory
+            {
+                std::string name;
+                struct timespec mtime;
+            };
+
+            std::string pathVariable_;
+            std::vector<Directory> directories_;
+            EntriesType entries_;
+
+            void update();
+            bool isValid(const Entry& entry);
+            bool search(const std::string& name, Entry& entry) const;
+    };
+}}
+
+#endif /* PATHCACHE_HPP_ */
@@ -0,0 +1,103 @@
+/*
+ * pipeline.hpp - Sequence of commands connected through pipes
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cli
+{
+    //
+    // Class Pipeline
+    //
+    // Commands parsed from the command line that have to run together, the
+    // output of each one connected to the input of the next. Interpreters
+    // whose parsers do not support pipes always get one-command pipelines.
+    //
+
+    template <typename Arguments>
+    class Pipeline
+    {
+        public:
+
+            struct Command
+            {
+                std::string name;
+                Arguments arguments;
+            };
+
+            typedef std::vector<Command> CommandsType;
+
+            //
+            // Append a new command to be filled by the parser. The commands
+            // dropped by clear() are reused, so the memory of their strings
+            // and vectors is not allocated again. Unless isCleared is false,
+            // they are emptied first. Arguments has to have a clear() member
+            // that keeps that memory, like those of the standard containers.
+            //
+
+            Command& add(bool isCleared = true)
+            {
+                if (spare_.empty()) {
+                    commands_.resize(commands_.size() + 1);
+                    return commands_.back();
+                }
+                commands_.push_back(std::move(spare_.back()));
+                spare_.pop_back();
+                Command& command = commands_.back();
+                if (isCleared) {
+                    command.name.clear();
+                    command.arguments.clear();
+                }
+                return command;
+            }
+
+            void clear()
+            {
+                for (typename CommandsType::reverse_iterator i =
+                    commands_.rbegin(); i != commands_.rend(); ++i)
+                {
+                    spare_.push_back(std::move(*i));
+                }
+                commands_.clear();
+            }
+
+            bool empty() const
+                { return commands_.empty(); }
+
+            size_t size() const
+                { return commands_.size(); }
+
+            const Command& front() const
+                { return commands_.front(); }
+            const Command& back() const
+                { return commands_.back(); }
+
+            const CommandsType& commands() const
+                { return commands_; }
+
+        private:
+            CommandsType commands_;
+            CommandsType spare_;
+    };
+}
+
+#endif /* PIPELINE_HPP_ */
@@ -19,16 +19,32 @@
 #ifndef SHELL_HPP_
 #define SHELL_HPP_
 
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 
 #include <boost/algorithm/string/join.hpp>
+#include <boost/function.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/spirit/include/qi.hpp>
 
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <cli/argumentsview.hpp>
 #include <cli/basic_spirit.hpp>
 #include <cli/callbacks.hpp>
+#include <cli/environment.hpp>
 #include <cli/glob.hpp>
+#include <cli/jobs.hpp>
+#include <cli/launcher.hpp>
+#include <cli/parsearena.hpp>
+#include <cli/pathcache.hpp>
 #include <cli/utility.hpp>
 
 namespace cli
@@ -74,7 +90,9 @@ namespace cli { namespace parser { namespace shellparser
         {
             NORMAL,             // command ;
             BACKGROUNDED,       // command &
-            PIPED               // command1 | command2
+            PIPED,              // command1 | command2
+            AND,                // command1 && command2
+            OR                  // command1 || command2
         };
 
         std::vector<VariableAssignment> variables;
@@ -84,10 +102,78 @@ namespace cli { namespace parser { namespace shellparser
 
         Arguments() : terminator(NORMAL) {}
 
+        // Empty the vectors but keep their memory, to be reused by the
+        // next command
+        void clear()
+        {
+            variables.clear();
+            arguments.clear();
+            redirections.clear();
+            terminator = NORMAL;
+        }
+
         std::string getCommandName() const
             { return arguments.empty() ? std::string() : arguments[0]; }
     };
 
+    //
+    // Class Word
+    //
+    // Words as written in the command line, split in the parts that have
+    // to be expanded differently. The parser does not expand them until the
+    // whole command has been parsed, so the alternatives of the grammar that
+    // are discarded never look up variables or the filesystem.
+    //
+    // They only live while the command is parsed, so their memory is taken
+    // from the ParseArena of the parser.
+    //
+
+    struct WordPart
+    {
+        enum TypeOfPart
+        {
+            TEXT,               // Unquoted characters, subject to globbing
+            QUOTED_TEXT,        // Characters inside quotes
+            VARIABLE,           // $name or ${name}
+            QUOTED_VARIABLE     // $name or ${name} inside double quotes
+        };
+
+        TypeOfPart type;
+        ParseString text;
+    };
+
+    typedef std::vector<WordPart, ParseAllocator<WordPart> > Word;
+
+    struct RawVariableAssignment
+    {
+        ParseString name;
+        Word value;
+    };
+
+    struct RawStdioRedirection
+    {
+        StdioRedirection::TypeOfRedirection type;
+        Word argument;
+        // Where the argument is, to report it if it expands to several words
+        boost::iterator_range<std::string::const_iterator> source;
+    };
+
+    struct RawArguments
+    {
+        typedef std::vector<RawVariableAssignment,
+            ParseAllocator<RawVariableAssignment> > VariablesType;
+        typedef std::vector<Word, ParseAllocator<Word> > WordsType;
+        typedef std::vector<RawStdioRedirection,
+            ParseAllocator<RawStdioRedirection> > RedirectionsType;
+
+        VariablesType variables;
+        WordsType words;
+        RedirectionsType redirections;
+        Arguments::TypeOfTerminator terminator;
+
+        RawArguments() : terminator(Arguments::NORMAL) {}
+    };
+
     //
     // Overload insertion operator (<<) for class Arguments.
     // It is required to debug the parser rules.
@@ -144,6 +230,12 @@ namespace cli { namespace parser { namespace shellparser
             case Arguments::PIPED:
                 os << "Arguments::PIPED";
                 break;
+            case Arguments::AND:
+                os << "Arguments::AND";
+                break;
+            case Arguments::OR:
+                os << "Arguments::OR";
+                break;
             default:
                 os << "UNKNOWN" << '(' << static_cast<int>(type) << ')';
                 break;
@@ -251,10 +343,31 @@ namespace cli { namespace parser { namespace shellparser
     template <typename Iterator>
     struct ShellParser
         : qi::grammar<Iterator, fusion::vector<std::string&, Arguments&>(),
-              iso8859_1::space_type>
+              iso8859_1::space_type>,
+          spiritparser::ExpectationTracker<Iterator>
     {
         ShellParser(ShellInterpreter& interpreter);
 
+        //
+        // Parse a command made only of plain words separated by spaces,
+        // without quotes, expansions, redirections or terminators, as most
+        // lines of scripts are. Returns false if it needs the full grammar.
+        //
+
+        bool parseSimpleCommand(Iterator& begin, Iterator end,
+            std::string& command, Arguments& arguments) const;
+
+        //
+        // Commands are kept in the parse cache only if none of their words
+        // needed variable or pathname expansion, so they do not depend on
+        // anything but the text. The cache is not used while there is an
+        // onPathnameExpansion callback.
+        //
+
+        bool isParseCacheEnabled() const;
+        bool isLastCommandLiteral() const
+            { return isLastCommandLiteral_; }
+
         //
         // Parser rules
         //
@@ -295,44 +408,94 @@ namespace cli { namespace parser { namespace shellparser
             }
         } pipe;
 
+        struct Conditionals
+            : qi::symbols<char, Arguments::TypeOfTerminator>
+        {
+            Conditionals()
+            {
+                add
+                    ("&&", Arguments::AND)
+                    ("||", Arguments::OR)
+                ;
+            }
+        } conditionals;
+
+        using spiritparser::ExpectationTracker<Iterator>::expected;
+
         qi::rule<Iterator> eol;
         qi::rule<Iterator> neol;
         qi::rule<Iterator, char()> character;
         qi::rule<Iterator, char()> dereference;
         qi::rule<Iterator, char()> special;
         qi::rule<Iterator, char()> escape;
-        qi::rule<Iterator, std::string()> name;
-        qi::rule<Iterator, std::string(), qi::locals<bool> > variable;
-        qi::rule<Iterator, std::string()> quotedString;
-        qi::rule<Iterator, std::string()> doubleQuotedString;
-        qi::rule<Iterator, std::string()> word;
-        qi::rule<Iterator, std::vector<std::string>()> expandedWord;
-        qi::rule<Iterator, std::string()> variableValue;
-        qi::rule<Iterator, void(bool)> unambiguousRedirection;
-        qi::rule<Iterator, std::string(),
-            qi::locals<int> > redirectionArgument;
-        qi::rule<Iterator, VariableAssignment()> assignment;
-        qi::rule<Iterator, StdioRedirection(),
+        qi::rule<Iterator, ParseString()> name;
+        qi::rule<Iterator, ParseString()> parameter;
+        qi::rule<Iterator, ParseString(), qi::locals<bool> > variable;
+        qi::rule<Iterator, ParseString()> quotedString;
+        qi::rule<Iterator, Word()> doubleQuotedString;
+        qi::rule<Iterator, Word()> word;
+        qi::rule<Iterator, RawVariableAssignment()> assignment;
+        qi::rule<Iterator, RawStdioRedirection(),
             iso8859_1::space_type> redirection;
-        qi::rule<Iterator, Arguments(), iso8859_1::space_type> command;
+        qi::rule<Iterator, RawArguments(), iso8859_1::space_type> command;
         qi::rule<Iterator, fusion::vector<std::string&, Arguments&>(),
             iso8859_1::space_type> start;
 
         private:
             ShellInterpreter& interpreter_;
+            bool isLastCommandLiteral_;
+
+            //
+            // Expansion of the words of a command once it has been parsed
+            //
+
+            void expandArguments(const RawArguments& raw,
+                Arguments& arguments);
+            template <typename Words>
+            void expandWord(const Word& word, Words& words);
 
             //
             // Auxiliary methods
             //
 
-            static std::string globEscape(const std::string& pattern)
-                { return glob::Glob::escape(pattern); }
+            static void appendToWord(Word& word, WordPart::TypeOfPart type,
+                const ParseString& text);
+            static void appendCharacterToWord(Word& word,
+                WordPart::TypeOfPart type, char character)
+                { appendToWord(word, type, ParseString(1, character)); }
 
-            static std::string stringsJoin(const std::vector<std::string>& v)
+            template <typename Strings>
+            static std::string stringsJoin(const Strings& v)
                 { return boost::algorithm::join(v, std::string(1, ' ')); }
     };
 }}}
 
+namespace cli { namespace parser { namespace spiritparser
+{
+    template <typename Iterator>
+    struct FastPath<shellparser::ShellParser<Iterator> >
+    {
+        static bool parse(shellparser::ShellParser<Iterator>& grammar,
+            Iterator& begin, Iterator end, std::string& command,
+            shellparser::Arguments& arguments)
+        {
+            return grammar.parseSimpleCommand(begin, end, command,
+                arguments);
+        }
+    };
+
+    template <typename Iterator>
+    struct ParseCachePolicy<shellparser::ShellParser<Iterator> >
+    {
+        static bool isEnabled(
+            const shellparser::ShellParser<Iterator>& grammar)
+            { return grammar.isParseCacheEnabled(); }
+        static bool isCacheable(
+            const shellparser::ShellParser<Iterator>& grammar)
+            { return grammar.isLastCommandLiteral(); }
+    };
+}}}
+
 namespace cli
 {
     using namespace cli::parser;
@@ -341,6 +504,15 @@ namespace cli
     typedef shellparser::VariableAssignment VariableAssignment;
     typedef shellparser::StdioRedirection StdioRedirection;
 
+    //
+    // Append to fileActions the operations required to set up the
+    // redirections of a command in the child process
+    //
+
+    void stdioRedirectionsToFileActions(
+        const std::vector<StdioRedirection>& redirections,
+        launcher::FileActions& fileActions);
+
     namespace traits
     {
         template <>
@@ -358,6 +530,39 @@ namespace cli
     // Interpreter which uses ShellParser to parse the command line, emulating
     // a very simple shell.
     //
+    // Background pipelines are queued when every job slot is in use, like
+    // 'make -j' does, and started as the running ones finish: when a new
+    // line is read, when the jobs are waited for and at the end of the
+    // input, if the interpreter is not interactive.
+    //
+    // Commands prefixed by 'batch [-P jobs]' have their arguments split, like
+    // xargs does, into as many runs as needed to keep every one under the
+    // ARG_MAX limit of the system. The command name, and the options that
+    // follow it, are repeated in every run. With -P, up to 'jobs' runs are
+    // launched at once, or one per online CPU if it is 0. The prefix hides
+    // the batch command of at(1), which has to be run by its full path.
+    //
+    // If the interpreter is not interactive, the last command of the input
+    // replaces it with exec() when it is an external program run in the
+    // foreground, as other shells do.
+    //
+    // Pipelines prefixed by 'time' are measured: the wall and CPU time, the
+    // maximum resident set size and the context switches of every command,
+    // as reported by wait4(), and the time the interpreter spent parsing the
+    // pipeline, expanding its words and launching its processes.
+    //
+    // Pipelines prefixed by 'place [-c cpus] [-n nice] [-s policy]' are
+    // launched with that CPU affinity, nice value and scheduling policy,
+    // instead of the default placement of the interpreter. When a pipeline
+    // of several commands gets more than one CPU, every command is pinned
+    // to one of them, in an order that keeps neighbouring commands on
+    // sibling cores, so the data sent through each pipe stays in a shared
+    // cache.
+    //
+    // Commands that need the full grammar but have no variable, pathname or
+    // tilde expansion are kept in parseCache(), so scripts that repeat them
+    // in loops parse them only once.
+    //
 
     class ShellInterpreter
         : public cli::BasicSpiritInterpreter<ShellArguments,
@@ -371,6 +576,90 @@ namespace cli
             ShellInterpreter(std::istream& in, std::ostream& out,
                 std::ostream& err = std::cerr, bool useReadline = true);
 
+            //
+            // Members to configure how external programs are launched
+            //
+
+            launcher::Launcher& launcher()
+                { return *launcher_; }
+            void launcherBackend(launcher::Launcher::Backend backend);
+
+            launcher::PathCache& pathCache()
+                { return pathCache_; }
+
+            //
+            // Members to manage the jobs started by the interpreter
+            //
+
+            jobs::JobTable& jobs()
+                { return jobs_; }
+
+            //
+            // Members to limit how many background jobs run at once. By
+            // default, one per online CPU.
+            //
+
+            // A queued job starts later from the working directory and with
+            // the environment it had when it was queued
+            struct QueuedJob
+            {
+                PipelineType pipeline;
+                int workingDirectory;           // O_PATH descriptor or -1
+                std::vector<std::string> environment;
+            };
+
+            typedef std::deque<QueuedJob> QueuedJobsType;
+
+            size_t jobSlots() const
+                { return jobSlots_; }
+            void jobSlots(size_t slots);
+
+            const QueuedJobsType& queuedJobs() const
+                { return queuedJobs_; }
+
+            //
+            // Members to set where the jobs run when they are not prefixed
+            // by 'place'. By default, they inherit the placement of the
+            // interpreter.
+            //
+
+            const launcher::Placement& placement() const
+                { return placement_; }
+            void placement(const launcher::Placement& placement);
+
+            //
+            // Start the queued jobs that fit in the free slots. If
+            // waitForSlots is true, wait until every one has been started.
+            //
+
+            void runQueuedJobs(bool waitForSlots = false);
+
+            //
+            // Exit status of the last pipeline, as expanded by $?. Commands
+            // implemented by callbacks exit with status 0 unless they set
+            // another one.
+            //
+
+            int lastStatus() const
+                { return lastStatus_; }
+            void lastStatus(int status)
+                { lastStatus_ = status; }
+
+            //
+            // Register a builtin that only reads its arguments. It gets them
+            // as an ArgumentsView, where the words written as is in a line
+            // taken by the fast path refer to that line instead of being
+            // copied to strings. It is registered in onRunCommand too, so it
+            // runs wherever any other builtin would. It has to be replaced
+            // through this member, not through onRunCommand.
+            //
+
+            typedef boost::function<bool (const std::string&,
+                ArgumentsView const&)> RunCommandViewType;
+
+            void onRunCommandView(const std::string& command,
+                const RunCommandViewType& callback);
+
             //
             // Accessors of callback functions
             //
@@ -379,6 +668,112 @@ namespace cli
             cli::callback::PathnameExpansionCallback onPathnameExpansion;
 
         private:
+            // The parser expands the words of the commands with
+            // variableLookup() and pathnameExpansion()
+            template <typename> friend struct shellparser::ShellParser;
+
+            jobs::JobTable jobs_;
+            boost::shared_ptr<launcher::Launcher> launcher_;
+            launcher::PathCache pathCache_;
+            launcher::Environment environment_;
+
+            size_t jobSlots_;
+            QueuedJobsType queuedJobs_;
+
+            // Builtins registered by onRunCommandView(). The fast path puts
+            // the words of their commands in argumentsView_ and leaves the
+            // name alone in the ShellArguments pointed by viewedArguments_.
+            typedef std::map<std::string, RunCommandViewType, std::less<> >
+                RunCommandViewsType;
+
+            RunCommandViewsType runCommandViews_;
+            ArgumentsView argumentsView_;
+            const ShellArguments* viewedArguments_;     // NULL if none
+            bool isArgumentsViewInUse_;
+
+            launcher::Placement placement_;
+            const launcher::Placement* jobPlacement_;   // NULL if not placed
+
+            int lastStatus_;
+
+            // The pipelines that follow a failed && or a successful || are
+            // parsed, because the parser has to find where they end, but
+            // neither expanded nor launched
+            bool isSkipping_;
+
+            //
+            // Measures of the pipelines prefixed by 'time'
+            //
+
+            struct StageTimes
+            {
+                std::string commandLine;
+                pid_t pid;                  // -1 if it ran in the interpreter
+                struct timespec startTime;
+                double spawnTime;           // Seconds to launch it
+                double realTime;            // Negative if it did not finish
+                struct rusage usage;
+            };
+
+            std::vector<StageTimes>* stageTimes_;   // NULL if not timing
+            size_t timedStage_;
+
+            // Parsing and expansion happen together, before the pipeline is
+            // run, so they are measured for every pipeline
+            struct timespec parseStartTime_;
+            double expansionTime_;
+
+            //
+            // Hook methods invoked for command execution
+            //
+
+            virtual bool runPipeline(const PipelineType& pipeline);
+            bool executePipeline(const PipelineType& pipeline);
+            bool launchPipeline(const PipelineType& pipeline);
+            bool timePipeline(const PipelineType& pipeline);
+            bool batchPipeline(const PipelineType& pipeline);
+            bool placePipeline(const PipelineType& pipeline);
+            const launcher::Placement& jobPlacement() const
+                { return jobPlacement_ != NULL ? *jobPlacement_ : placement_; }
+            size_t runningBackgroundJobs() const;
+            void queueJob(const PipelineType& pipeline);
+            void startQueuedJob(QueuedJob& job);
+            void reportTimes(const std::vector<StageTimes>& stages,
+                double realTime, double parseTime, double expansionTime);
+            virtual bool isPipedCommand(ShellArguments const& arguments) const
+                { return arguments.terminator == ShellArguments::PIPED; }
+
+            virtual bool runCommand(const std::string& command,
+                ShellArguments const& arguments);
+            bool runCommandView(const std::string& command,
+                ShellArguments const& arguments);
+            bool prepareSpawnRequest(const std::string& command,
+                ShellArguments const& arguments,
+                const std::vector<int>& pipes,
+                launcher::SpawnRequest& request);
+            pid_t spawnCommand(const std::string& command,
+                ShellArguments const& arguments,
+                const std::vector<int>& pipes,
+                launcher::SpawnRequest& request, int& status);
+            void execCommand(const std::string& command,
+                ShellArguments const& arguments);
+            void runCommandInChild(const std::string& command,
+                ShellArguments const& arguments);
+            bool runBuiltin(const std::string& command,
+                ShellArguments const& arguments, int input, int output,
+                const std::vector<int>& pipes);
+
+            //
+            // Hook methods invoked inside interpretOneLine()
+            //
+
+            virtual void preRunCommand(std::string& line);
+
+            //
+            // Hook methods invoked once inside loop()
+            //
+
+            virtual void postLoop();
 
             //
             // Hook methods invoked during parsing
@@ -388,6 +783,13 @@ namespace cli
             std::vector<std::string> pathnameExpansion(
                 const std::string& pattern);
     };
+
+    //
+    // Join the words of the commands of a pipeline, as typed by the user
+    //
+
+    std::string pipelineToString(
+        const ShellInterpreter::PipelineType& pipeline);
 }
 
 #endif /* SHELL_HPP_ */
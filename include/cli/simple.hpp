@@ -47,6 +47,12 @@ namespace cli
             typedef std::string ArgumentsType;
             typedef std::string ErrorType;
         };
+
+        template <>
+        struct ParserOverwritesArguments<SimpleParser>
+        {
+            static const bool value = true;
+        };
     }
 
     typedef CommandLineInterpreterBase<SimpleParser> SimpleInterpreter;
@@ -24,6 +24,19 @@ namespace cli { namespace traits
     template <typename Parser>
     struct ParserTraits
     {};
+
+    //
+    // Parsers that replace the command name and the arguments they are
+    // given, instead of adding to them, may get the ones of a previous
+    // command, so the memory of their strings is reused. Parsers have to
+    // specialize it to allow that.
+    //
+
+    template <typename Parser>
+    struct ParserOverwritesArguments
+    {
+        static const bool value = false;
+    };
 }}
 
 #endif /* TRAITS_HPP_ */
@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 
+#include <boost/noncopyable.hpp>
 #include <boost/shared_array.hpp>
 #include <boost/type_traits/is_convertible.hpp>
 #include <boost/utility/enable_if.hpp>
@@ -43,7 +44,8 @@ namespace cli { namespace utility
     const char* programShortName();
 
     //
-    // Functions for std::vector<std::string> to char*[] conversion
+    // Functions for std::vector<std::string> to char*[] conversion. Every
+    // string is allocated on its own, so ArgV is preferred.
     //
 
     char** stdVectorStringToArgV(const std::vector<std::string> &strings);
@@ -51,6 +53,39 @@ namespace cli { namespace utility
     boost::shared_array<char*> stdVectorStringToSmartArgV(
         const std::vector<std::string> &strings);
 
+    //
+    // Class ArgV
+    //
+    // NULL-terminated char*[] built from a std::vector<std::string>, as
+    // required by exec() and posix_spawn(). The pointers and a copy of the
+    // strings are stored in a single buffer, sized before copying anything,
+    // which is reused by later calls to assign().
+    //
+
+    class ArgV : private boost::noncopyable
+    {
+        public:
+            ArgV() : size_(0) {}
+            explicit ArgV(const std::vector<std::string>& strings)
+                { assign(strings); }
+
+            void assign(const std::vector<std::string>& strings);
+
+            char** get()
+                { return buffer_.empty() ? NULL :
+                    reinterpret_cast<char**>(&buffer_[0]); }
+
+            char* operator[](size_t index)
+                { return get()[index]; }
+
+            size_t size() const
+                { return size_; }
+
+        private:
+            std::vector<char> buffer_;
+            size_t size_;
+    };
+
     //
     // Function for parse error type to std::string conversion
     //
@@ -54,7 +54,8 @@ namespace cli { namespace parser { namespace wordsparser
     struct WordsParser
         : qi::grammar<Iterator,
               fusion::vector<std::string&, Arguments&>(),
-              iso8859_1::space_type>
+              iso8859_1::space_type>,
+          spiritparser::ExpectationTracker<Iterator>
     {
         WordsParser();
 
@@ -62,6 +63,8 @@ namespace cli { namespace parser { namespace wordsparser
         // Parser rules
         //
 
+        using spiritparser::ExpectationTracker<Iterator>::expected;
+
         qi::rule<Iterator> eol;
         qi::rule<Iterator, char()> character;
         qi::rule<Iterator, char()> escape;
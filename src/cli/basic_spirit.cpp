@@ -33,27 +33,65 @@ namespace cli { namespace parser { namespace spiritparser
     //
 
     SpiritParseError::SpiritParseError()
-        : expectationFailureWhat_(""),
+        : expected_(NULL),
+          expectationFailureWhat_(""),
           expectationFailure_(false)
     {}
 
     SpiritParseError::SpiritParseError(const std::string& what)
         : what_(what),
+          expected_(NULL),
           expectationFailureWhat_(""),
           expectationFailure_(false)
     {}
 
+    SpiritParseError::SpiritParseError(std::string::const_iterator first,
+        std::string::const_iterator last, const char* expected)
+        : expectationFailureFirst_(first),
+          expectationFailureLast_(last),
+          expected_(expected),
+          expectationFailureWhat_(""),
+          expectationFailure_(true)
+    {}
+
     SpiritParseError::SpiritParseError(
         const qi::expectation_failure<std::string::const_iterator>& e)
         : what_(),
           expectationFailureFirst_(e.first),
           expectationFailureLast_(e.last),
+          expected_(NULL),
           expectationFailureWhat_(e.what_),
           expectationFailure_(true)
+    {}
+
+    const std::string& SpiritParseError::what() const
+    {
+        if (! what_.empty()) {
+            return what_;
+        }
+
+        if (expectationFailure_) {
+            what_ += translate("syntax error, expecting");
+            what_ += " ";
+            what_ += expected_ != NULL ? std::string(expected_) :
+                expectationFailureWhat_.tag;
+            what_ += std::string(" ") + translate("at") + ": ";
+            what_ += (expectationFailureFirst_ == expectationFailureLast_) ?
+                translate("<end-of-line>") :
+                std::string(expectationFailureFirst_,
+                    expectationFailureLast_);
+        }
+        else {
+            what_ = translate("syntax error");
+        }
+        return what_;
+    }
+
+    boost::spirit::info SpiritParseError::expectationFailureWhat() const
     {
-        what_ += translate("syntax error, expecting");
-        what_ += " " + e.what_.tag + " " + translate("at") + ": ";
-        what_ += (e.first == e.last) ? translate("<end-of-line>") :
-            std::string(e.first, e.last);
+        if (expected_ != NULL) {
+            return boost::spirit::info(expected_);
+        }
+        return expectationFailureWhat_;
     }
 }}}
@@ -0,0 +1,107 @@
+/*
+ * environment.cpp - Environment of the programs launched by an interpreter
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cli/environment.hpp>
+
+namespace cli { namespace launcher
+{
+    //
+    // Class Environment
+    //
+
+    void Environment::set(const std::string& name, const std::string& value)
+    {
+        std::string assignment = name + '=' + value;
+
+        // The last assignment to a name wins
+        for (std::vector<std::string>::iterator i = assignments_.begin();
+            i < assignments_.end(); ++i)
+        {
+            if (i->compare(0, name.size() + 1, assignment, 0,
+                name.size() + 1) == 0) {
+                *i = assignment;
+                return;
+            }
+        }
+        assignments_.push_back(assignment);
+    }
+
+    char* const* Environment::envp()
+    {
+        if (assignments_.empty()) {
+            return NULL;
+        }
+
+        update();
+
+        envp_ = snapshot_;
+        envp_.pop_back();       // NULL
+        for (std::vector<std::string>::iterator i = assignments_.begin();
+            i < assignments_.end(); ++i)
+        {
+            char* assignment = &(*i)[0];
+            IndexType::const_iterator j =
+                index_.find(i->substr(0, i->find('=')));
+            if (j == index_.end()) {
+                envp_.push_back(assignment);
+            }
+            else {
+                envp_[j->second] = assignment;
+            }
+        }
+        envp_.push_back(NULL);
+        return &envp_[0];
+    }
+
+    //
+    // Index the variables in environ again if it has changed since the last
+    // time. Comparing the pointers is enough, because setenv() and putenv()
+    // replace them.
+    //
+
+    void Environment::update()
+    {
+        size_t size = 0;
+        bool isValid = ! snapshot_.empty();
+        for (char** i = environ; *i != NULL; ++i, ++size) {
+            if (isValid && (size >= snapshot_.size() ||
+                snapshot_[size] != *i)) {
+                isValid = false;
+            }
+        }
+        if (isValid && size + 1 == snapshot_.size()) {
+            return;
+        }
+
+        snapshot_.assign(environ, environ + size + 1);
+        index_.clear();
+        for (size_t i = 0; i < size; ++i) {
+            const char* equal = std::strchr(snapshot_[i], '=');
+            std::string name = equal == NULL ?
+                std::string(snapshot_[i]) :
+                std::string(snapshot_[i], equal - snapshot_[i]);
+            index_[name] = i;
+        }
+    }
+}}
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include <cstring>
 #include <string>
 #include <utility>
 #include <vector>
@@ -87,22 +88,31 @@ namespace glob
     std::string Glob::escape(const std::string& pattern)
     {
         std::string escaped;
+        appendEscaped(escaped, pattern.data(),
+            pattern.data() + pattern.size());
+        return escaped;
+    }
 
-        for (std::string::const_iterator i = pattern.begin();
-            i < pattern.end(); ++i)
-        {
-            switch (*i) {
-            case '~':   // EXPAND_TILDE
-            case '*':
-            case '?':
-            case '[':
-            case '\\':
-                escaped.push_back('\\');
-            default:
-                escaped.push_back(*i);
-            }
-        }
+    bool Glob::isPattern(const std::string& pattern, GlobFlags flags)
+    {
+        return isPattern(pattern.c_str(), flags);
+    }
 
-        return escaped;
+    bool Glob::isPattern(const char* pattern, GlobFlags flags)
+    {
+        std::string metaCharacters("*?[");
+        if (! (flags & NO_ESCAPE_CHARACTER)) {
+            metaCharacters += '\\';
+        }
+#if defined(_GNU_SOURCE)
+        if (flags & EXPAND_BRACE_EXPRESSIONS) {
+            metaCharacters += '{';
+        }
+        if ((flags & (EXPAND_TILDE | EXPAND_TILDE_WITH_CHECK)) &&
+            pattern[0] == '~') {
+            return true;
+        }
+#endif /* _GNU_SOURCE */
+        return std::strpbrk(pattern, metaCharacters.c_str()) != NULL;
     }
 }
@@ -0,0 +1,505 @@
+/*
+ * jobs.cpp - Table of the jobs started by an interpreter
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cli/jobs.hpp>
+
+#include "config.h"
+
+#if defined(HAVE_PIDFD_OPEN) || defined(HAVE_PIDFD_SEND_SIGNAL)
+// Some glibc versions declare these functions without C linkage for C++
+extern "C" {
+#include <sys/pidfd.h>
+}
+#endif
+
+namespace cli { namespace jobs
+{
+    //
+    // Get a pidfd for a child. It can not refer to another process, because
+    // the PID is not reused until the child is reaped.
+    //
+
+    static int openPidFd(pid_t pid)
+    {
+#if defined(HAVE_PIDFD_OPEN)
+        return ::pidfd_open(pid, 0);
+#else
+        return -1;
+#endif /* HAVE_PIDFD_OPEN */
+    }
+
+    static void closePidFd(Job::Process& process)
+    {
+        if (process.pidFd >= 0) {
+            ::close(process.pidFd);
+            process.pidFd = -1;
+        }
+    }
+
+    //
+    // Class JobTable
+    //
+
+    JobTable::JobTable()
+        : terminal_(-1),
+          interpreterProcessGroup_(::getpgrp())
+    {
+        sigset_t mask;
+        ::sigemptyset(&mask);
+        ::sigaddset(&mask, SIGCHLD);
+        ::sigprocmask(SIG_BLOCK, &mask, &savedSignalMask_);
+        signalFd_ = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        // Job control only makes sense if the interpreter owns the terminal
+        if (::isatty(STDIN_FILENO) &&
+            ::tcgetpgrp(STDIN_FILENO) == interpreterProcessGroup_) {
+            terminal_ = STDIN_FILENO;
+        }
+    }
+
+    JobTable::~JobTable()
+    {
+        while (! jobs_.empty()) {
+            remove(jobs_.begin()->second);
+        }
+        if (signalFd_ >= 0) {
+            ::close(signalFd_);
+        }
+        ::sigprocmask(SIG_SETMASK, &savedSignalMask_, NULL);
+    }
+
+    Job& JobTable::add(pid_t pid, pid_t processGroup,
+        const std::string& commandLine, bool isBackground)
+    {
+        // Like other shells, numbers are reused once the jobs are removed
+        int id = jobs_.empty() ? 1 : jobs_.rbegin()->first + 1;
+        Job& job = jobs_[id];
+        job.id = id;
+        job.processGroup = processGroup;
+        job.state = Job::RUNNING;
+        job.status = 0;
+        ::clock_gettime(CLOCK_MONOTONIC, &job.startTime);
+        job.isBackground = isBackground;
+
+        Job::Process process = { pid, Job::RUNNING, 0, openPidFd(pid) };
+        job.processes.push_back(process);
+        job.commandLine = commandLine;
+        return job;
+    }
+
+    void JobTable::addProcess(Job& job, pid_t pid,
+        const std::string& commandLine)
+    {
+        Job::Process process = { pid, Job::RUNNING, 0, openPidFd(pid) };
+        job.processes.push_back(process);
+        job.commandLine += " | " + commandLine;
+    }
+
+    Job* JobTable::find(int id)
+    {
+        JobsType::iterator i = jobs_.find(id);
+        return i == jobs_.end() ? NULL : &i->second;
+    }
+
+    Job* JobTable::findByPid(pid_t pid)
+    {
+        for (JobsType::iterator i = jobs_.begin(); i != jobs_.end(); ++i) {
+            std::vector<Job::Process>& processes = i->second.processes;
+            for (std::vector<Job::Process>::iterator j = processes.begin();
+                j < processes.end(); ++j)
+            {
+                if (j->pid == pid) {
+                    return &i->second;
+                }
+            }
+        }
+        return NULL;
+    }
+
+    Job::Process* JobTable::findProcess(pid_t pid)
+    {
+        Job* job = findByPid(pid);
+        if (job == NULL) {
+            return NULL;
+        }
+        for (std::vector<Job::Process>::iterator i = job->processes.begin();
+            i < job->processes.end(); ++i)
+        {
+            if (i->pid == pid) {
+                return &*i;
+            }
+        }
+        return NULL;
+    }
+
+    Job* JobTable::current()
+    {
+        return jobs_.empty() ? NULL : &jobs_.rbegin()->second;
+    }
+
+    //
+    // Reap every process of the jobs that has changed state. It does nothing
+    // but a read() on the signalfd when no SIGCHLD is pending. Other children
+    // of the process, like those of the host application or the server of a
+    // launcher, are left to their owners.
+    //
+
+    void JobTable::update()
+    {
+        bool isPending = false;
+        struct signalfd_siginfo info;
+        while (::read(signalFd_, &info, sizeof(info)) == sizeof(info)) {
+            isPending = true;
+        }
+        if (! isPending) {
+            return;
+        }
+
+        for (JobsType::iterator i = jobs_.begin(); i != jobs_.end(); ++i) {
+            std::vector<Job::Process>& processes = i->second.processes;
+            for (std::vector<Job::Process>::iterator j = processes.begin();
+                j < processes.end(); ++j)
+            {
+                int status;
+                struct rusage usage;
+                while (j->state != Job::DONE && ::wait4(j->pid, &status,
+                    WNOHANG | WUNTRACED | WCONTINUED, &usage) == j->pid) {
+                    processStatus(j->pid, status, usage);
+                }
+            }
+        }
+    }
+
+    void JobTable::processStatus(pid_t pid, int status,
+        const struct rusage& usage)
+    {
+        Job* job = findByPid(pid);
+        if (job == NULL) {
+            return;
+        }
+
+        bool isRunning = false;
+        bool isStopped = false;
+        std::vector<Job::Process>& processes = job->processes;
+        for (std::vector<Job::Process>::iterator i = processes.begin();
+            i < processes.end(); ++i)
+        {
+            if (i->pid == pid) {
+                if (WIFSTOPPED(status)) {
+                    i->state = Job::STOPPED;
+                }
+                else if (WIFCONTINUED(status)) {
+                    i->state = Job::RUNNING;
+                }
+                else {
+                    i->state = Job::DONE;
+                    i->status = status;
+                    i->usage = usage;
+                    ::clock_gettime(CLOCK_MONOTONIC, &i->endTime);
+                    closePidFd(*i);
+                }
+            }
+            isRunning = isRunning || i->state == Job::RUNNING;
+            isStopped = isStopped || i->state == Job::STOPPED;
+        }
+
+        if (isRunning) {
+            job->state = Job::RUNNING;
+        }
+        else if (isStopped) {
+            job->state = Job::STOPPED;
+        }
+        else {
+            job->state = Job::DONE;
+            job->status = processes.back().status;
+        }
+    }
+
+    //
+    // Sleep until a process of the jobs changes state. The processes whose
+    // pidfd is ready have exited and are reaped right away. The signalfd is
+    // polled too, because stopped and continued processes, and those
+    // without pidfd, are only reported through SIGCHLD.
+    //
+
+    void JobTable::waitForChanges(const std::vector<Job*>& jobs)
+    {
+        std::vector<struct pollfd> pollFds;
+        std::vector<pid_t> pids;
+        struct pollfd signalPollFd = { signalFd_, POLLIN, 0 };
+        pollFds.push_back(signalPollFd);
+        pids.push_back(0);
+        for (std::vector<Job*>::const_iterator i = jobs.begin();
+            i < jobs.end(); ++i)
+        {
+            std::vector<Job::Process>& processes = (*i)->processes;
+            for (std::vector<Job::Process>::iterator j = processes.begin();
+                j < processes.end(); ++j)
+            {
+                if (j->state == Job::RUNNING && j->pidFd >= 0) {
+                    struct pollfd pollFd = { j->pidFd, POLLIN, 0 };
+                    pollFds.push_back(pollFd);
+                    pids.push_back(j->pid);
+                }
+            }
+        }
+
+        if (::poll(&pollFds[0], pollFds.size(), -1) < 0) {
+            return;
+        }
+
+        for (size_t i = 1; i < pollFds.size(); ++i) {
+            int status;
+            struct rusage usage;
+            if ((pollFds[i].revents & POLLIN) &&
+                ::wait4(pids[i], &status, WNOHANG, &usage) == pids[i]) {
+                processStatus(pids[i], status, usage);
+            }
+        }
+        if (pollFds[0].revents & POLLIN) {
+            update();
+        }
+    }
+
+    //
+    // Sleep until a process of any running job changes state. Returns false
+    // if there is no job running.
+    //
+
+    bool JobTable::waitForChanges()
+    {
+        std::vector<Job*> running;
+        for (JobsType::iterator i = jobs_.begin(); i != jobs_.end(); ++i) {
+            if (i->second.state == Job::RUNNING) {
+                running.push_back(&i->second);
+            }
+        }
+        if (running.empty()) {
+            return false;
+        }
+        waitForChanges(running);
+        return true;
+    }
+
+    //
+    // Wait until the job finishes or is stopped. Returns its status.
+    //
+
+    int JobTable::wait(Job& job)
+    {
+        update();
+        std::vector<Job*> jobs(1, &job);
+        while (job.state == Job::RUNNING) {
+            waitForChanges(jobs);
+        }
+        return job.status;
+    }
+
+    //
+    // Wait until any job finishes. Jobs that had already finished are
+    // returned first. Returns NULL if there is no job running.
+    //
+
+    Job* JobTable::waitAny()
+    {
+        update();
+        while (true) {
+            std::vector<Job*> running;
+            for (JobsType::iterator i = jobs_.begin(); i != jobs_.end(); ++i)
+            {
+                if (i->second.state == Job::DONE) {
+                    return &i->second;
+                }
+                if (i->second.state == Job::RUNNING) {
+                    running.push_back(&i->second);
+                }
+            }
+            if (running.empty()) {
+                return NULL;
+            }
+            waitForChanges(running);
+        }
+    }
+
+    //
+    // Move the job to the foreground and wait for it. If finished is not
+    // NULL and the job finishes, it is copied there before being removed.
+    //
+
+    int JobTable::foreground(Job& job, bool resume, Job* finished)
+    {
+        job.isBackground = false;
+        terminal(job.processGroup);
+        if (resume) {
+            continueJob(job);
+        }
+
+        int status = wait(job);
+        terminal(interpreterProcessGroup_);
+
+        if (job.state == Job::DONE) {
+            if (finished != NULL) {
+                *finished = job;
+            }
+            remove(job);
+        }
+        return status;
+    }
+
+    void JobTable::background(Job& job)
+    {
+        job.isBackground = true;
+        continueJob(job);
+    }
+
+    //
+    // Send SIGCONT to the processes of a stopped job. They are marked as
+    // running right away, so wait() does not return before they finish.
+    //
+
+    void JobTable::continueJob(Job& job)
+    {
+        if (job.processGroup > 0) {
+            ::killpg(job.processGroup, SIGCONT);
+        }
+        for (std::vector<Job::Process>::iterator i = job.processes.begin();
+            i < job.processes.end(); ++i)
+        {
+            if (job.processGroup <= 0) {
+                ::kill(i->pid, SIGCONT);
+            }
+            if (i->state == Job::STOPPED) {
+                i->state = Job::RUNNING;
+                job.state = Job::RUNNING;
+            }
+        }
+    }
+
+    void JobTable::remove(Job& job)
+    {
+        for (std::vector<Job::Process>::iterator i = job.processes.begin();
+            i < job.processes.end(); ++i)
+        {
+            closePidFd(*i);
+        }
+        jobs_.erase(job.id);
+    }
+
+    int JobTable::signal(Job& job, int signum)
+    {
+        int error = ESRCH;
+        for (std::vector<Job::Process>::iterator i = job.processes.begin();
+            i < job.processes.end(); ++i)
+        {
+            if (i->state != Job::DONE) {
+                int result = signal(i->pid, signum);
+                if (error) {
+                    error = result;
+                }
+            }
+        }
+        return error;
+    }
+
+    int JobTable::signal(pid_t pid, int signum)
+    {
+#if defined(HAVE_PIDFD_SEND_SIGNAL)
+        Job::Process* process = findProcess(pid);
+        if (process != NULL && process->pidFd >= 0) {
+            return ::pidfd_send_signal(process->pidFd, signum, NULL, 0) < 0 ?
+                errno : 0;
+        }
+        if (process != NULL && process->state == Job::DONE) {
+            return ESRCH;
+        }
+#endif /* HAVE_PIDFD_SEND_SIGNAL */
+        return ::kill(pid, signum) < 0 ? errno : 0;
+    }
+
+    std::vector<Job> JobTable::takeFinished()
+    {
+        update();
+
+        std::vector<Job> finished;
+        for (JobsType::iterator i = jobs_.begin(); i != jobs_.end();) {
+            if (i->second.state == Job::DONE) {
+                finished.push_back(i->second);
+                jobs_.erase(i++);
+            }
+            else {
+                ++i;
+            }
+        }
+        return finished;
+    }
+
+    //
+    // Hand the terminal to the process group. SIGTTOU is blocked meanwhile,
+    // because the interpreter may not be in the foreground anymore.
+    //
+
+    void JobTable::terminal(pid_t processGroup)
+    {
+        if (terminal_ < 0 || processGroup <= 0) {
+            return;
+        }
+
+        sigset_t mask, oldMask;
+        ::sigemptyset(&mask);
+        ::sigaddset(&mask, SIGTTOU);
+        ::sigprocmask(SIG_BLOCK, &mask, &oldMask);
+        ::tcsetpgrp(terminal_, processGroup);
+        ::sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    }
+
+    //
+    // Functions to show jobs
+    //
+
+    const char* stateToString(const Job& job)
+    {
+        switch (job.state) {
+        case Job::RUNNING:
+            return "Running";
+        case Job::STOPPED:
+            return "Stopped";
+        case Job::DONE:
+            if (WIFSIGNALED(job.status)) {
+                return ::strsignal(WTERMSIG(job.status));
+            }
+            return WEXITSTATUS(job.status) == 0 ? "Done" : "Exit";
+        default:
+            return "Unknown";
+        }
+    }
+}}
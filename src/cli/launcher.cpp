@@ -0,0 +1,1428 @@
+/*
+ * launcher.cpp - Launch external programs without copying the address space
+ *                of the calling process when it can be avoided
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cli/detail/utility.hpp>
+#include <cli/launcher.hpp>
+#include <cli/utility.hpp>
+
+#include "config.h"
+
+namespace cli { namespace launcher
+{
+    //
+    // Class FileActions
+    //
+
+    void FileActions::addOpen(int fd, const std::string& path, int flags,
+        mode_t mode)
+    {
+        Action action = { OPEN, fd, -1, path, flags, mode };
+        actions_.push_back(action);
+    }
+
+    void FileActions::addDup2(int fd, int newFd)
+    {
+        Action action = { DUP2, fd, newFd, std::string(), 0, 0 };
+        actions_.push_back(action);
+    }
+
+    void FileActions::addClose(int fd)
+    {
+        Action action = { CLOSE, fd, -1, std::string(), 0, 0 };
+        actions_.push_back(action);
+    }
+
+    //
+    // Functions to apply file actions
+    //
+
+    int applyFileActions(const FileActions& fileActions)
+    {
+        const FileActions::ActionsType& actions = fileActions.actions();
+        for (FileActions::ActionsType::const_iterator i = actions.begin();
+            i < actions.end(); ++i)
+        {
+            switch (i->type) {
+            case FileActions::OPEN: {
+                int fd = ::open(i->path.c_str(), i->flags | O_CLOEXEC,
+                    i->mode);
+                if (fd < 0) {
+                    return errno;
+                }
+                if (fd != i->fd) {
+                    int error = ::dup2(fd, i->fd) < 0 ? errno : 0;
+                    ::close(fd);
+                    if (error) {
+                        return error;
+                    }
+                }
+                else {
+                    ::fcntl(fd, F_SETFD, 0);
+                }
+                break;
+            }
+            case FileActions::DUP2:
+                if (::dup2(i->fd, i->newFd) < 0) {
+                    return errno;
+                }
+                break;
+            case FileActions::CLOSE:
+                ::close(i->fd);
+                break;
+            }
+        }
+        return 0;
+    }
+
+    //
+    // Functions to close the descriptors inherited by the children. They are
+    // async-signal-safe. close_range() is used when available, so the cost
+    // does not depend on the limit of open files.
+    //
+
+    static int maxDescriptors()
+    {
+        struct rlimit limit;
+        if (::getrlimit(RLIMIT_NOFILE, &limit) < 0 ||
+            limit.rlim_cur == RLIM_INFINITY) {
+            return 1024;
+        }
+        return limit.rlim_cur;
+    }
+
+    //
+    // Set the close-on-exec flag of every descriptor from lowFd up. The
+    // descriptors set up later by dup2() do not get the flag, so it has to
+    // be called before the file actions are applied.
+    //
+
+    static void closeOnExecFrom(int lowFd)
+    {
+#if defined(HAVE_CLOSE_RANGE) && defined(CLOSE_RANGE_CLOEXEC)
+        if (::close_range(lowFd, ~0U, CLOSE_RANGE_CLOEXEC) == 0) {
+            return;
+        }
+#endif /* HAVE_CLOSE_RANGE && CLOSE_RANGE_CLOEXEC */
+        int maxFd = maxDescriptors();
+        for (int fd = lowFd; fd < maxFd; ++fd) {
+            int flags = ::fcntl(fd, F_GETFD);
+            if (flags >= 0 && ! (flags & FD_CLOEXEC)) {
+                ::fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+            }
+        }
+    }
+
+    static void closeRange(int lowFd, int highFd)
+    {
+#if defined(HAVE_CLOSE_RANGE)
+        if (::close_range(lowFd, highFd, 0) == 0) {
+            return;
+        }
+#endif /* HAVE_CLOSE_RANGE */
+        int maxFd = maxDescriptors();
+        for (int fd = lowFd; fd <= highFd && fd < maxFd; ++fd) {
+            ::close(fd);
+        }
+    }
+
+    //
+    // Class Launcher
+    //
+
+    boost::shared_ptr<Launcher> Launcher::create(Backend backend)
+    {
+        switch (backend) {
+        case FORK:
+            return boost::shared_ptr<Launcher>(new ForkLauncher);
+        case VFORK:
+            return boost::shared_ptr<Launcher>(new VforkLauncher);
+#if defined(__linux__)
+        case FORK_SERVER:
+            return boost::shared_ptr<Launcher>(new ForkServerLauncher);
+#endif /* __linux__ */
+        case POSIX_SPAWN:
+        default:
+            return boost::shared_ptr<Launcher>(new PosixSpawnLauncher);
+        }
+    }
+
+    bool Launcher::stringToBackend(const std::string& name,
+        Backend& backend)
+    {
+        if (name == "fork") {
+            backend = FORK;
+        }
+        else if (name == "posix_spawn") {
+            backend = POSIX_SPAWN;
+        }
+        else if (name == "vfork") {
+            backend = VFORK;
+        }
+        else if (name == "forkserver") {
+            backend = FORK_SERVER;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* Launcher::backendToString(Backend backend)
+    {
+        switch (backend) {
+        case FORK:
+            return "fork";
+        case POSIX_SPAWN:
+            return "posix_spawn";
+        case VFORK:
+            return "vfork";
+        case FORK_SERVER:
+            return "forkserver";
+        default:
+            return "unknown";
+        }
+    }
+
+    //
+    // Class Placement
+    //
+
+    bool Placement::stringToCpus(const std::string& list,
+        std::vector<int>& cpus)
+    {
+        std::vector<int> result;
+        const char* current = list.c_str();
+        while (*current != '\0') {
+            char* end;
+            long first = std::strtol(current, &end, 10);
+            long last = first;
+            if (end == current || first < 0) {
+                return false;
+            }
+            if (*end == '-') {
+                current = end + 1;
+                last = std::strtol(current, &end, 10);
+                if (end == current || last < first) {
+                    return false;
+                }
+            }
+            if (last >= CPU_SETSIZE) {
+                return false;
+            }
+            for (long cpu = first; cpu <= last; ++cpu) {
+                result.push_back(cpu);
+            }
+            if (*end == ',') {
+                ++end;
+            }
+            else if (*end != '\0') {
+                return false;
+            }
+            current = end;
+        }
+        if (result.empty()) {
+            return false;
+        }
+        cpus.swap(result);
+        return true;
+    }
+
+    bool Placement::stringToNiceness(const std::string& value,
+        int& niceness)
+    {
+        const char* current = value.c_str();
+        char* end;
+        errno = 0;
+        long result = std::strtol(current, &end, 10);
+        if (end == current || *end != '\0' || errno != 0 ||
+            result < -20 || result > 19) {
+            return false;
+        }
+        niceness = result;
+        return true;
+    }
+
+    bool Placement::stringToPolicy(const std::string& name, int& policy)
+    {
+        if (name == "other") {
+            policy = SCHED_OTHER;
+        }
+        else if (name == "batch") {
+            policy = SCHED_BATCH;
+        }
+        else if (name == "idle") {
+            policy = SCHED_IDLE;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* Placement::policyToString(int policy)
+    {
+        switch (policy) {
+        case SCHED_OTHER:
+            return "other";
+        case SCHED_BATCH:
+            return "batch";
+        case SCHED_IDLE:
+            return "idle";
+        default:
+            return "unknown";
+        }
+    }
+
+    std::string Placement::toString() const
+    {
+        std::string result;
+        if (! cpus.empty()) {
+            result += "cpu ";
+            for (std::vector<int>::const_iterator i = cpus.begin();
+                i < cpus.end(); ++i)
+            {
+                char number[16];
+                std::snprintf(number, sizeof(number),
+                    i == cpus.begin() ? "%d" : ",%d", *i);
+                result += number;
+            }
+        }
+        if (isNicenessSet) {
+            char number[16];
+            std::snprintf(number, sizeof(number), "%d", niceness);
+            result += result.empty() ? "nice " : " nice ";
+            result += number;
+        }
+        if (policy >= 0) {
+            result += result.empty() ? "" : " ";
+            result += policyToString(policy);
+        }
+        return result;
+    }
+
+    int applyPlacement(const Placement& placement)
+    {
+        if (! placement.cpus.empty()) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (std::vector<int>::const_iterator i = placement.cpus.begin();
+                i < placement.cpus.end(); ++i)
+            {
+                CPU_SET(*i, &cpus);
+            }
+            if (::sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+                return errno;
+            }
+        }
+        if (placement.policy >= 0) {
+            struct sched_param parameters;
+            std::memset(&parameters, 0, sizeof(parameters));
+            if (::sched_setscheduler(0, placement.policy, &parameters) < 0) {
+                return errno;
+            }
+        }
+        if (placement.isNicenessSet &&
+            ::setpriority(PRIO_PROCESS, 0, placement.niceness) < 0) {
+            return errno;
+        }
+        return 0;
+    }
+
+    //
+    // Read a number from a topology file of a CPU, or -1 if it is missing
+    //
+
+    static long cpuTopology(int cpu, const char* name)
+    {
+        char path[128];
+        std::snprintf(path, sizeof(path),
+            "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+        FILE* file = std::fopen(path, "re");
+        long value = -1;
+        if (file != NULL) {
+            if (std::fscanf(file, "%ld", &value) != 1) {
+                value = -1;
+            }
+            std::fclose(file);
+        }
+        return value;
+    }
+
+    struct CpuLocation
+    {
+        long package;
+        long core;
+        int cpu;
+
+        bool operator<(const CpuLocation& other) const
+        {
+            if (package != other.package) {
+                return package < other.package;
+            }
+            if (core != other.core) {
+                return core < other.core;
+            }
+            return cpu < other.cpu;
+        }
+    };
+
+    void sortCpusBySiblings(std::vector<int>& cpus)
+    {
+        std::vector<CpuLocation> locations;
+        for (std::vector<int>::const_iterator i = cpus.begin();
+            i < cpus.end(); ++i)
+        {
+            CpuLocation location = { cpuTopology(*i, "physical_package_id"),
+                cpuTopology(*i, "core_id"), *i };
+            locations.push_back(location);
+        }
+        std::sort(locations.begin(), locations.end());
+        cpus.clear();
+        for (std::vector<CpuLocation>::const_iterator i = locations.begin();
+            i < locations.end(); ++i)
+        {
+            if (cpus.empty() || cpus.back() != i->cpu) {
+                cpus.push_back(i->cpu);
+            }
+        }
+    }
+
+    //
+    // Class Launcher
+    //
+
+    Launcher::Launcher()
+    {
+        ::pthread_sigmask(SIG_SETMASK, NULL, &childSignalMask_);
+    }
+
+    pid_t Launcher::spawn(const SpawnRequest& request)
+    {
+        errorCode_.clear();
+        if (request.childHook || request.arguments.empty()) {
+            return forkAndExec(request);
+        }
+        return doSpawn(request);
+    }
+
+    //
+    // exec() without fork(). The signal mask and the environment of the
+    // caller are restored if it fails.
+    //
+
+    int Launcher::exec(const SpawnRequest& request)
+    {
+        cli::utility::ArgV argv(request.arguments);
+
+        if (request.closeDescriptors) {
+            closeOnExecFrom(3);
+        }
+        int error = applyFileActions(request.fileActions);
+        if (! error) {
+            error = applyPlacement(request.placement);
+        }
+        if (! error) {
+            sigset_t savedSignalMask;
+            ::sigprocmask(SIG_SETMASK, &childSignalMask_, &savedSignalMask);
+            char** savedEnviron = environ;
+            if (request.environment != NULL) {
+                environ = const_cast<char**>(request.environment);
+            }
+            if (request.path.empty()) {
+                ::execvp(argv[0], argv.get());
+            }
+            else {
+                ::execv(request.path.c_str(), argv.get());
+            }
+            error = errno;
+            environ = savedEnviron;
+            ::sigprocmask(SIG_SETMASK, &savedSignalMask, NULL);
+        }
+        errorCode_ = std::error_code(error, std::system_category());
+        return -1;
+    }
+
+    //
+    // fork() + exec(). If exec() fails the child reports errno through a
+    // close-on-exec pipe, so the caller sees the error as it would with
+    // posix_spawn().
+    //
+
+    pid_t Launcher::forkAndExec(const SpawnRequest& request)
+    {
+        cli::utility::ArgV argv(request.arguments);
+
+        int errorPipe[2];
+        if (::pipe2(errorPipe, O_CLOEXEC) < 0) {
+            errorCode_ = std::error_code(errno, std::system_category());
+            return -1;
+        }
+
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(errorPipe[0]);
+            ::sigprocmask(SIG_SETMASK, &childSignalMask_, NULL);
+            int error = 0;
+            if (request.processGroup >= 0 &&
+                ::setpgid(0, request.processGroup) < 0) {
+                error = errno;
+            }
+            if (! error) {
+                error = applyPlacement(request.placement);
+            }
+            if (! error) {
+                if (request.closeDescriptors) {
+                    closeOnExecFrom(3);
+                }
+                error = applyFileActions(request.fileActions);
+            }
+            if (! error) {
+                if (request.childHook) {
+                    request.childHook();
+                }
+                if (request.arguments.empty()) {
+                    ::_exit(0);
+                }
+                if (request.environment != NULL) {
+                    environ = const_cast<char**>(request.environment);
+                }
+                if (request.path.empty()) {
+                    ::execvp(argv[0], argv.get());
+                }
+                else {
+                    ::execv(request.path.c_str(), argv.get());
+                }
+                error = errno;
+            }
+            while (::write(errorPipe[1], &error, sizeof(error)) < 0 &&
+                errno == EINTR);
+            ::_exit(127);
+        }
+
+        ::close(errorPipe[1]);
+        if (pid < 0) {
+            errorCode_ = std::error_code(errno, std::system_category());
+            ::close(errorPipe[0]);
+            return -1;
+        }
+
+        // Avoid the race with the child: both set the process group
+        if (request.processGroup >= 0) {
+            ::setpgid(pid, request.processGroup == 0 ?
+                pid : request.processGroup);
+        }
+
+        int error = 0;
+        ssize_t n;
+        while ((n = ::read(errorPipe[0], &error, sizeof(error))) < 0 &&
+            errno == EINTR);
+        ::close(errorPipe[0]);
+        if (n == sizeof(error)) {
+            ::waitpid(pid, NULL, 0);
+            errorCode_ = std::error_code(error, std::system_category());
+            return -1;
+        }
+        return pid;
+    }
+
+    //
+    // Class PosixSpawnLauncher
+    //
+
+    pid_t PosixSpawnLauncher::doSpawn(const SpawnRequest& request)
+    {
+        // posix_spawn() can not change the affinity nor the nice value of
+        // the child, and glibc only accepts the POSIX scheduling policies
+        const Placement& placement = request.placement;
+        if (! placement.cpus.empty() || placement.isNicenessSet ||
+            (placement.policy >= 0 && placement.policy != SCHED_OTHER)) {
+            return forkAndExec(request);
+        }
+
+        cli::utility::ArgV argv(request.arguments);
+
+        ::posix_spawn_file_actions_t fileActions;
+        ::posix_spawn_file_actions_init(&fileActions);
+
+        const FileActions::ActionsType& actions =
+            request.fileActions.actions();
+        for (FileActions::ActionsType::const_iterator i = actions.begin();
+            i < actions.end(); ++i)
+        {
+            switch (i->type) {
+            case FileActions::OPEN:
+                ::posix_spawn_file_actions_addopen(&fileActions, i->fd,
+                    i->path.c_str(), i->flags, i->mode);
+                break;
+            case FileActions::DUP2:
+                ::posix_spawn_file_actions_adddup2(&fileActions, i->fd,
+                    i->newFd);
+                break;
+            case FileActions::CLOSE:
+                ::posix_spawn_file_actions_addclose(&fileActions, i->fd);
+                break;
+            }
+        }
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+        // It closes the descriptors set up by the actions too, so it can
+        // only be used if they are the standard ones
+        if (request.closeDescriptors) {
+            bool isStdioOnly = true;
+            for (FileActions::ActionsType::const_iterator i = actions.begin();
+                i < actions.end(); ++i)
+            {
+                int fd = i->type == FileActions::DUP2 ? i->newFd : i->fd;
+                if (i->type != FileActions::CLOSE && fd > STDERR_FILENO) {
+                    isStdioOnly = false;
+                }
+            }
+            if (isStdioOnly) {
+                ::posix_spawn_file_actions_addclosefrom_np(&fileActions,
+                    STDERR_FILENO + 1);
+            }
+        }
+#endif /* HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
+        ::posix_spawnattr_t attributes;
+        ::posix_spawnattr_init(&attributes);
+        short flags = POSIX_SPAWN_SETSIGMASK;
+        ::posix_spawnattr_setsigmask(&attributes, &childSignalMask_);
+        if (request.processGroup >= 0) {
+            flags |= POSIX_SPAWN_SETPGROUP;
+            ::posix_spawnattr_setpgroup(&attributes, request.processGroup);
+        }
+        if (placement.policy >= 0) {
+            struct sched_param parameters;
+            std::memset(&parameters, 0, sizeof(parameters));
+            flags |= POSIX_SPAWN_SETSCHEDULER;
+            ::posix_spawnattr_setschedpolicy(&attributes, placement.policy);
+            ::posix_spawnattr_setschedparam(&attributes, &parameters);
+        }
+        ::posix_spawnattr_setflags(&attributes, flags);
+
+        char* const* envp = request.environment == NULL ?
+            environ : request.environment;
+        pid_t pid;
+        int error;
+        if (request.path.empty()) {
+            error = ::posix_spawnp(&pid, argv[0], &fileActions, &attributes,
+                argv.get(), envp);
+        }
+        else {
+            error = ::posix_spawn(&pid, request.path.c_str(), &fileActions,
+                &attributes, argv.get(), envp);
+        }
+
+        ::posix_spawnattr_destroy(&attributes);
+        ::posix_spawn_file_actions_destroy(&fileActions);
+
+        if (error) {
+            errorCode_ = std::error_code(error, std::system_category());
+            return -1;
+        }
+        return pid;
+    }
+
+    //
+    // Class VforkLauncher
+    //
+
+    //
+    // Room for the frames of vforkChild() and the functions it calls. Like
+    // posix_spawn() in glibc, room for argc + 2 pointers is added, because
+    // execvpe() copies the arguments to the stack to run scripts without
+    // #! through /bin/sh.
+    //
+
+    const size_t CHILD_STACK_SIZE = 64 * 1024;
+
+    static size_t childStackSize(size_t argc, size_t pageSize)
+    {
+        size_t size = CHILD_STACK_SIZE + (argc + 2) * sizeof(char*);
+        return (size + pageSize - 1) / pageSize * pageSize;
+    }
+
+    struct VforkChildArguments
+    {
+        const SpawnRequest* request;
+        char** argv;
+        const sigset_t* signalMask;
+        int error;
+    };
+
+    //
+    // Code run by the child while it borrows the memory of the parent. The
+    // parent blocks every signal before clone(), so handlers installed by
+    // the host application can not run here on the shared memory. They are
+    // reset to the default disposition before setting the signal mask
+    // requested for the child.
+    //
+
+    static int vforkChild(void* data)
+    {
+        VforkChildArguments* arguments =
+            static_cast<VforkChildArguments*>(data);
+
+        struct sigaction action;
+        for (int signum = 1; signum < NSIG; ++signum) {
+            if (::sigaction(signum, NULL, &action) == 0 &&
+                action.sa_handler != SIG_IGN &&
+                action.sa_handler != SIG_DFL) {
+                action.sa_handler = SIG_DFL;
+                ::sigaction(signum, &action, NULL);
+            }
+        }
+        ::sigprocmask(SIG_SETMASK, arguments->signalMask, NULL);
+
+        const SpawnRequest* request = arguments->request;
+        if (request->processGroup >= 0 &&
+            ::setpgid(0, request->processGroup) < 0) {
+            arguments->error = errno;
+            ::_exit(127);
+        }
+
+        int error = applyPlacement(request->placement);
+        if (error) {
+            arguments->error = error;
+            ::_exit(127);
+        }
+
+        if (request->closeDescriptors) {
+            closeOnExecFrom(3);
+        }
+        error = applyFileActions(request->fileActions);
+        if (error) {
+            arguments->error = error;
+            ::_exit(127);
+        }
+
+        // environ belongs to the parent too, so it is not modified here
+        char* const* envp = request->environment == NULL ?
+            environ : request->environment;
+        if (request->path.empty()) {
+#if defined(_GNU_SOURCE)
+            ::execvpe(arguments->argv[0], arguments->argv, envp);
+#else
+            ::execvp(arguments->argv[0], arguments->argv);
+#endif /* _GNU_SOURCE */
+        }
+        else {
+            ::execve(request->path.c_str(), arguments->argv, envp);
+        }
+        arguments->error = errno;
+        ::_exit(127);
+    }
+
+    pid_t VforkLauncher::doSpawn(const SpawnRequest& request)
+    {
+        cli::utility::ArgV argv(request.arguments);
+
+        VforkChildArguments arguments;
+        arguments.request = &request;
+        arguments.argv = argv.get();
+        arguments.signalMask = &childSignalMask_;
+        arguments.error = 0;
+
+#if defined(__linux__)
+        // The child gets a new stack for every request, so it fits the
+        // arguments and the launcher can be used from several threads. The
+        // stack grows down on every architecture supported by Linux but HP
+        // PA-RISC, so the guard page at the bottom makes an overflow fault
+        // instead of writing over the memory of the parent.
+        size_t pageSize = ::sysconf(_SC_PAGESIZE);
+        size_t stackSize = childStackSize(request.arguments.size(),
+            pageSize) + pageSize;
+        void* stack = ::mmap(NULL, stackSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack == MAP_FAILED) {
+            errorCode_ = std::error_code(errno, std::system_category());
+            return -1;
+        }
+        ::mprotect(stack, pageSize, PROT_NONE);
+#endif /* __linux__ */
+
+        sigset_t allSignals, signalMask;
+        ::sigfillset(&allSignals);
+        ::pthread_sigmask(SIG_SETMASK, &allSignals, &signalMask);
+
+#if defined(__linux__)
+        char* stackTop = static_cast<char*>(stack) + stackSize;
+        pid_t pid = ::clone(vforkChild, stackTop,
+            CLONE_VM | CLONE_VFORK | SIGCHLD, &arguments);
+#else
+        pid_t pid = ::vfork();
+        if (pid == 0) {
+            vforkChild(&arguments);
+        }
+#endif /* __linux__ */
+        int cloneError = errno;
+
+        ::pthread_sigmask(SIG_SETMASK, &signalMask, NULL);
+#if defined(__linux__)
+        ::munmap(stack, stackSize);
+#endif /* __linux__ */
+
+        if (pid < 0) {
+            errorCode_ = std::error_code(cloneError, std::system_category());
+            return -1;
+        }
+
+        // The parent resumes once the child has called exec() or exited,
+        // so the error reported through the shared memory is already there
+        if (arguments.error) {
+            ::waitpid(pid, NULL, 0);
+            errorCode_ = std::error_code(arguments.error,
+                std::system_category());
+            return -1;
+        }
+        return pid;
+    }
+
+    //
+    // Class ForkServerLauncher
+    //
+
+#if defined(__linux__)
+    //
+    // Messages exchanged with the fork server. A request is a header, sent
+    // together with the descriptors, followed by size bytes of payload.
+    //
+
+    const size_t MAX_SERVER_DESCRIPTORS = 253;      // SCM_MAX_FD
+
+    struct ServerRequestHeader
+    {
+        uint32_t size;
+        uint32_t descriptorCount;
+    };
+
+    struct ServerReply
+    {
+        int32_t pid;
+        int32_t error;
+    };
+
+    class MessageWriter
+    {
+        public:
+            template <typename T>
+            void put(const T& value)
+            {
+                const char* bytes = reinterpret_cast<const char*>(&value);
+                buffer_.insert(buffer_.end(), bytes, bytes + sizeof(value));
+            }
+
+            void putString(const char* value)
+            {
+                uint32_t length = std::strlen(value);
+                put(length);
+                buffer_.insert(buffer_.end(), value, value + length);
+            }
+
+            const std::vector<char>& buffer() const
+                { return buffer_; }
+
+        private:
+            std::vector<char> buffer_;
+    };
+
+    class MessageReader
+    {
+        public:
+            MessageReader(const std::vector<char>& buffer)
+                : current_(buffer.empty() ? NULL : &buffer[0]),
+                  end_(current_ + buffer.size())
+            {}
+
+            template <typename T>
+            bool get(T& value)
+            {
+                if (end_ - current_ < static_cast<ssize_t>(sizeof(value))) {
+                    return false;
+                }
+                std::memcpy(&value, current_, sizeof(value));
+                current_ += sizeof(value);
+                return true;
+            }
+
+            bool getString(std::string& value)
+            {
+                uint32_t length;
+                if (! get(length) ||
+                    static_cast<size_t>(end_ - current_) < length) {
+                    return false;
+                }
+                value.assign(current_, length);
+                current_ += length;
+                return true;
+            }
+
+        private:
+            const char* current_;
+            const char* end_;
+    };
+
+    static bool readAll(int fd, void* buffer, size_t size)
+    {
+        char* data = static_cast<char*>(buffer);
+        while (size > 0) {
+            ssize_t n = ::read(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool writeAll(int fd, const void* buffer, size_t size)
+    {
+        const char* data = static_cast<const char*>(buffer);
+        while (size > 0) {
+            ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    //
+    // Request decoded by the fork server. Descriptors are already the ones
+    // received by the server.
+    //
+
+    struct ServerRequest
+    {
+        pid_t processGroup;
+        sigset_t signalMask;
+        std::string path;
+        std::vector<std::string> arguments;
+        std::vector<std::string> environment;
+        int stdioDescriptors[3];
+        int workingDirectory;
+        bool closeDescriptors;
+        FileActions fileActions;
+        Placement placement;
+    };
+
+    static int receivedDescriptor(const std::vector<int>& descriptors,
+        int32_t index)
+    {
+        return index >= 0 && static_cast<size_t>(index) < descriptors.size() ?
+            descriptors[index] : -1;
+    }
+
+    static bool decodeServerRequest(const std::vector<char>& payload,
+        const std::vector<int>& descriptors, ServerRequest& request)
+    {
+        MessageReader reader(payload);
+
+        int32_t processGroup;
+        uint8_t closeDescriptors;
+        if (! reader.get(processGroup) || ! reader.get(request.signalMask) ||
+            ! reader.get(closeDescriptors) ||
+            ! reader.getString(request.path)) {
+            return false;
+        }
+        request.processGroup = processGroup;
+        request.closeDescriptors = closeDescriptors;
+
+        uint32_t count;
+        if (! reader.get(count)) {
+            return false;
+        }
+        request.arguments.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (! reader.getString(request.arguments[i])) {
+                return false;
+            }
+        }
+        if (! reader.get(count)) {
+            return false;
+        }
+        request.environment.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (! reader.getString(request.environment[i])) {
+                return false;
+            }
+        }
+
+        int32_t index;
+        for (int i = 0; i < 3; ++i) {
+            if (! reader.get(index)) {
+                return false;
+            }
+            request.stdioDescriptors[i] =
+                receivedDescriptor(descriptors, index);
+        }
+        if (! reader.get(index)) {
+            return false;
+        }
+        request.workingDirectory = receivedDescriptor(descriptors, index);
+
+        if (! reader.get(count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            int32_t type, fd, newFd, flags;
+            uint32_t mode;
+            std::string path;
+            if (! reader.get(type) || ! reader.get(fd) ||
+                ! reader.get(newFd) || ! reader.get(flags) ||
+                ! reader.get(mode) || ! reader.getString(path)) {
+                return false;
+            }
+            switch (type) {
+            case FileActions::OPEN:
+                request.fileActions.addOpen(fd, path, flags, mode);
+                break;
+            case FileActions::DUP2:
+                fd = receivedDescriptor(descriptors, fd);
+                if (fd >= 0) {
+                    request.fileActions.addDup2(fd, newFd);
+                }
+                else {
+                    request.fileActions.addClose(newFd);
+                }
+                break;
+            case FileActions::CLOSE:
+                // Descriptors not sent to the server are not open in the
+                // child anyway
+                fd = receivedDescriptor(descriptors, fd);
+                if (fd >= 0) {
+                    request.fileActions.addClose(fd);
+                }
+                break;
+            }
+        }
+
+        if (! reader.get(count) || count > CPU_SETSIZE) {
+            return false;
+        }
+        request.placement.cpus.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            int32_t cpu;
+            if (! reader.get(cpu) || cpu < 0 || cpu >= CPU_SETSIZE) {
+                return false;
+            }
+            request.placement.cpus[i] = cpu;
+        }
+        uint8_t isNicenessSet;
+        int32_t niceness, policy;
+        if (! reader.get(isNicenessSet) || ! reader.get(niceness) ||
+            ! reader.get(policy)) {
+            return false;
+        }
+        request.placement.isNicenessSet = isNicenessSet;
+        request.placement.niceness = niceness;
+        request.placement.policy = policy;
+        return true;
+    }
+
+    //
+    // Start the process described by request. The child is created with
+    // CLONE_PARENT, so it is reaped by the owner of the launcher.
+    //
+
+    static ServerReply serverSpawn(const ServerRequest& request)
+    {
+        cli::utility::ArgV argv(request.arguments);
+        cli::utility::ArgV envp(request.environment);
+
+        ServerReply reply = { -1, 0 };
+        int errorPipe[2];
+        if (::pipe2(errorPipe, O_CLOEXEC) < 0) {
+            reply.error = errno;
+            return reply;
+        }
+
+        pid_t pid = ::syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+        if (pid == 0) {
+            ::close(errorPipe[0]);
+            ::sigprocmask(SIG_SETMASK, &request.signalMask, NULL);
+            int error = 0;
+            if (request.processGroup >= 0 &&
+                ::setpgid(0, request.processGroup) < 0) {
+                error = errno;
+            }
+            if (! error && request.workingDirectory >= 0 &&
+                ::fchdir(request.workingDirectory) < 0) {
+                error = errno;
+            }
+            if (! error) {
+                error = applyPlacement(request.placement);
+            }
+            if (! error && request.closeDescriptors) {
+                closeOnExecFrom(3);
+            }
+            for (int fd = 0; fd < 3 && ! error; ++fd) {
+                if (request.stdioDescriptors[fd] < 0) {
+                    ::close(fd);
+                }
+                else if (::dup2(request.stdioDescriptors[fd], fd) < 0) {
+                    error = errno;
+                }
+            }
+            if (! error) {
+                error = applyFileActions(request.fileActions);
+            }
+            if (! error) {
+                // execvp() searches the PATH of the new environment
+                environ = envp.get();
+                if (request.path.empty()) {
+                    ::execvp(argv[0], argv.get());
+                }
+                else {
+                    ::execv(request.path.c_str(), argv.get());
+                }
+                error = errno;
+            }
+            while (::write(errorPipe[1], &error, sizeof(error)) < 0 &&
+                errno == EINTR);
+            ::_exit(127);
+        }
+
+        ::close(errorPipe[1]);
+        if (pid < 0) {
+            reply.error = errno;
+            ::close(errorPipe[0]);
+            return reply;
+        }
+
+        reply.pid = pid;
+        int error;
+        if (readAll(errorPipe[0], &error, sizeof(error))) {
+            reply.error = error;
+        }
+        ::close(errorPipe[0]);
+        return reply;
+    }
+
+    //
+    // Main loop of the fork server. It ends when the launcher closes its
+    // end of the socket.
+    //
+
+    static void runForkServer(int socket)
+    {
+        // Signals sent to the process group of the owner must not kill
+        // the server. Children set their own mask.
+        sigset_t allSignals;
+        ::sigfillset(&allSignals);
+        ::sigprocmask(SIG_SETMASK, &allSignals, NULL);
+
+        if (socket > 3) {
+            closeRange(3, socket - 1);
+        }
+        closeRange(socket + 1, ~0U >> 1);
+        // Keep the standard descriptors busy, so the received ones are
+        // never numbered 0, 1 or 2
+        for (int fd = 0; fd < 3; ++fd) {
+            if (::fcntl(fd, F_GETFD) < 0) {
+                ::open("/dev/null", O_RDWR);
+            }
+        }
+
+        std::vector<char> control(
+            CMSG_SPACE(MAX_SERVER_DESCRIPTORS * sizeof(int)));
+        while (true) {
+            ServerRequestHeader header;
+            struct iovec iov = { &header, sizeof(header) };
+            struct msghdr message;
+            std::memset(&message, 0, sizeof(message));
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = &control[0];
+            message.msg_controllen = control.size();
+
+            ssize_t n = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+
+            std::vector<int> descriptors;
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL;
+                cmsg = CMSG_NXTHDR(&message, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_RIGHTS) {
+                    const int* fds =
+                        reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                    descriptors.insert(descriptors.end(), fds, fds + count);
+                }
+            }
+
+            char* rest = reinterpret_cast<char*>(&header) + n;
+            std::vector<char> payload;
+            bool isOk = readAll(socket, rest, sizeof(header) - n);
+            if (isOk) {
+                payload.resize(header.size);
+                isOk = payload.empty() ||
+                    readAll(socket, &payload[0], payload.size());
+            }
+
+            ServerReply reply = { -1, EINVAL };
+            ServerRequest request;
+            if (isOk && decodeServerRequest(payload, descriptors, request)) {
+                reply = serverSpawn(request);
+            }
+
+            for (std::vector<int>::const_iterator i = descriptors.begin();
+                i < descriptors.end(); ++i)
+            {
+                ::close(*i);
+            }
+            if (! isOk || ! writeAll(socket, &reply, sizeof(reply))) {
+                break;
+            }
+        }
+        ::_exit(0);
+    }
+
+    ForkServerLauncher::ForkServerLauncher()
+        : socket_(-1), serverPid_(-1)
+    {
+        int sockets[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0,
+            sockets) < 0) {
+            errorCode_ = std::error_code(errno, std::system_category());
+            return;
+        }
+
+        serverPid_ = ::fork();
+        if (serverPid_ == 0) {
+            ::close(sockets[0]);
+            runForkServer(sockets[1]);
+        }
+
+        ::close(sockets[1]);
+        if (serverPid_ < 0) {
+            errorCode_ = std::error_code(errno, std::system_category());
+            ::close(sockets[0]);
+            return;
+        }
+        socket_ = sockets[0];
+    }
+
+    ForkServerLauncher::~ForkServerLauncher()
+    {
+        stopServer();
+    }
+
+    void ForkServerLauncher::stopServer()
+    {
+        if (socket_ >= 0) {
+            ::close(socket_);
+            socket_ = -1;
+            ::waitpid(serverPid_, NULL, 0);
+        }
+    }
+
+    //
+    // Index of fd in the descriptors sent to the server, or -1 if it is not
+    // open in the calling process
+    //
+
+    static int32_t addDescriptor(std::vector<int>& descriptors, int fd)
+    {
+        for (size_t i = 0; i < descriptors.size(); ++i) {
+            if (descriptors[i] == fd) {
+                return i;
+            }
+        }
+        if (::fcntl(fd, F_GETFD) < 0) {
+            return -1;
+        }
+        descriptors.push_back(fd);
+        return descriptors.size() - 1;
+    }
+
+    pid_t ForkServerLauncher::doSpawn(const SpawnRequest& request)
+    {
+        if (socket_ < 0) {
+            return forkAndExec(request);
+        }
+
+        std::vector<int> descriptors;
+        MessageWriter writer;
+        writer.put(static_cast<int32_t>(request.processGroup));
+        writer.put(childSignalMask_);
+        writer.put(static_cast<uint8_t>(request.closeDescriptors));
+        writer.putString(request.path.c_str());
+
+        writer.put(static_cast<uint32_t>(request.arguments.size()));
+        for (std::vector<std::string>::const_iterator i =
+            request.arguments.begin(); i < request.arguments.end(); ++i)
+        {
+            writer.putString(i->c_str());
+        }
+
+        char* const* envp = request.environment == NULL ?
+            environ : request.environment;
+        uint32_t count = 0;
+        for (char* const* i = envp; *i != NULL; ++i) {
+            ++count;
+        }
+        writer.put(count);
+        for (char* const* i = envp; *i != NULL; ++i) {
+            writer.putString(*i);
+        }
+
+        for (int fd = 0; fd < 3; ++fd) {
+            writer.put(addDescriptor(descriptors, fd));
+        }
+        int workingDirectory = ::open(".",
+            O_PATH | O_DIRECTORY | O_CLOEXEC);
+        writer.put(workingDirectory < 0 ? static_cast<int32_t>(-1) :
+            addDescriptor(descriptors, workingDirectory));
+
+        const FileActions::ActionsType& actions =
+            request.fileActions.actions();
+        writer.put(static_cast<uint32_t>(actions.size()));
+        for (FileActions::ActionsType::const_iterator i = actions.begin();
+            i < actions.end(); ++i)
+        {
+            // Only the descriptors open in this process have to be sent
+            int32_t fd = i->type == FileActions::OPEN ?
+                i->fd : addDescriptor(descriptors, i->fd);
+            int32_t newFd = i->newFd;
+            writer.put(static_cast<int32_t>(i->type));
+            writer.put(fd);
+            writer.put(newFd);
+            writer.put(static_cast<int32_t>(i->flags));
+            writer.put(static_cast<uint32_t>(i->mode));
+            writer.putString(i->path.c_str());
+        }
+
+        const Placement& placement = request.placement;
+        writer.put(static_cast<uint32_t>(placement.cpus.size()));
+        for (std::vector<int>::const_iterator i = placement.cpus.begin();
+            i < placement.cpus.end(); ++i)
+        {
+            writer.put(static_cast<int32_t>(*i));
+        }
+        writer.put(static_cast<uint8_t>(placement.isNicenessSet));
+        writer.put(static_cast<int32_t>(placement.niceness));
+        writer.put(static_cast<int32_t>(placement.policy));
+
+        if (descriptors.size() > MAX_SERVER_DESCRIPTORS) {
+            if (workingDirectory >= 0) {
+                ::close(workingDirectory);
+            }
+            return forkAndExec(request);
+        }
+
+        ServerRequestHeader header = { static_cast<uint32_t>(
+            writer.buffer().size()), static_cast<uint32_t>(
+            descriptors.size()) };
+        struct iovec iov = { &header, sizeof(header) };
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        std::vector<char> control(CMSG_SPACE(descriptors.size() *
+            sizeof(int)));
+        if (! descriptors.empty()) {
+            message.msg_control = &control[0];
+            message.msg_controllen = control.size();
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(descriptors.size() * sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &descriptors[0],
+                descriptors.size() * sizeof(int));
+        }
+
+        ssize_t n;
+        while ((n = ::sendmsg(socket_, &message, MSG_NOSIGNAL)) < 0 &&
+            errno == EINTR);
+        bool isOk = n > 0 &&
+            writeAll(socket_, reinterpret_cast<char*>(&header) + n,
+                sizeof(header) - n) &&
+            writeAll(socket_, &writer.buffer()[0], writer.buffer().size());
+
+        if (workingDirectory >= 0) {
+            ::close(workingDirectory);
+        }
+
+        ServerReply reply;
+        if (! isOk || ! readAll(socket_, &reply, sizeof(reply))) {
+            // The server is gone, so the request is served here
+            stopServer();
+            return forkAndExec(request);
+        }
+
+        if (reply.pid < 0) {
+            errorCode_ = std::error_code(reply.error, std::system_category());
+            return -1;
+        }
+
+        // Avoid the race with the child: both set the process group
+        if (request.processGroup >= 0) {
+            ::setpgid(reply.pid, request.processGroup == 0 ?
+                reply.pid : request.processGroup);
+        }
+
+        if (reply.error) {
+            ::waitpid(reply.pid, NULL, 0);
+            errorCode_ = std::error_code(reply.error, std::system_category());
+            return -1;
+        }
+        return reply.pid;
+    }
+#endif /* __linux__ */
+}}
@@ -0,0 +1,62 @@
+/*
+ * parsearena.cpp - Memory for the temporary objects built by the parsers
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory_resource>
+
+#include <cli/parsearena.hpp>
+
+namespace cli { namespace parser
+{
+    //
+    // Resource of the innermost scope of every thread. Interpreters running
+    // in different threads do not share their arenas.
+    //
+
+    static thread_local std::pmr::memory_resource* currentResource = NULL;
+
+    //
+    // Class ParseArena
+    //
+
+    ParseArena::ParseArena()
+        : resource_(buffer_, sizeof(buffer_)),
+          scopes_(0)
+    {}
+
+    std::pmr::memory_resource* ParseArena::current()
+    {
+        return currentResource != NULL ?
+            currentResource : std::pmr::new_delete_resource();
+    }
+
+    ParseArena::Scope::Scope(ParseArena& arena)
+        : arena_(arena),
+          previous_(currentResource)
+    {
+        ++arena_.scopes_;
+        currentResource = arena_.resource();
+    }
+
+    ParseArena::Scope::~Scope()
+    {
+        currentResource = previous_;
+        if (--arena_.scopes_ == 0) {
+            arena_.resource_.release();
+        }
+    }
+}}
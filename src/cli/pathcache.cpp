@@ -0,0 +1,219 @@
+/*
+ * pathcache.cpp - Cache of the location of programs found in the PATH
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cli/pathcache.hpp>
+
+namespace cli { namespace launcher
+{
+    //
+    // Search path used by execvp() when PATH is not set
+    //
+
+    const char DEFAULT_PATH[] = "/bin:/usr/bin";
+
+    static bool isSameTime(const struct timespec& a, const struct timespec& b)
+    {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+    }
+
+    //
+    // Class PathCache
+    //
+
+    bool PathCache::lookup(const std::string& name, std::string& path)
+    {
+        if (name.find('/') != std::string::npos) {
+            path = name;
+            return true;
+        }
+
+        update();
+
+        EntriesType::iterator i = entries_.find(name);
+        if (i != entries_.end() && ! isValid(i->second)) {
+            // isValid() may have dropped entries, the iterator included
+            i = entries_.find(name);
+        }
+
+        if (i == entries_.end()) {
+            Entry entry;
+            bool isCacheable = search(name, entry);
+            if (! isCacheable) {
+                path = entry.path;
+                return ! path.empty();
+            }
+            i = entries_.insert(std::make_pair(name, entry)).first;
+        }
+
+        ++i->second.hits;
+        path = i->second.path;
+        return ! path.empty();
+    }
+
+    bool PathCache::lookup(const std::string& name,
+        const std::string& pathVariable, std::string& path)
+    {
+        if (name.find('/') != std::string::npos) {
+            path = name;
+            return true;
+        }
+
+        std::string::size_type begin = 0;
+        while (true) {
+            std::string::size_type end = pathVariable.find(':', begin);
+            std::string directory = pathVariable.substr(begin,
+                end == std::string::npos ? std::string::npos : end - begin);
+            if (directory.empty()) {
+                directory = ".";
+            }
+
+            std::string candidate = directory + '/' + name;
+            struct stat buf;
+            if (::stat(candidate.c_str(), &buf) == 0 &&
+                S_ISREG(buf.st_mode) &&
+                ::access(candidate.c_str(), X_OK) == 0) {
+                path = candidate;
+                return true;
+            }
+            if (end == std::string::npos) {
+                return false;
+            }
+            begin = end + 1;
+        }
+    }
+
+    void PathCache::clear()
+    {
+        entries_.clear();
+        pathVariable_.clear();
+        directories_.clear();
+    }
+
+    //
+    // Reload the list of directories when the PATH variable has changed
+    //
+
+    void PathCache::update()
+    {
+        const char* pathVariable = ::getenv("PATH");
+        if (pathVariable == NULL) {
+            pathVariable = DEFAULT_PATH;
+        }
+        if (! directories_.empty() && pathVariable_ == pathVariable) {
+            return;
+        }
+
+        entries_.clear();
+        directories_.clear();
+        pathVariable_ = pathVariable;
+
+        std::string::size_type begin = 0;
+        while (true) {
+            std::string::size_type end = pathVariable_.find(':', begin);
+            Directory directory;
+            directory.name = pathVariable_.substr(begin,
+                end == std::string::npos ? std::string::npos : end - begin);
+            if (directory.name.empty()) {
+                directory.name = ".";
+            }
+            struct stat buf;
+            if (::stat(directory.name.c_str(), &buf) == 0) {
+                directory.mtime = buf.st_mtim;
+            }
+            else {
+                directory.mtime.tv_sec = 0;
+                directory.mtime.tv_nsec = 0;
+            }
+            directories_.push_back(directory);
+            if (end == std::string::npos) {
+                break;
+            }
+            begin = end + 1;
+        }
+    }
+
+    //
+    // An entry is still valid if no program has been added to or removed
+    // from any of the directories searched to resolve it. When a directory
+    // has changed, the entries that depend on it are dropped.
+    //
+
+    bool PathCache::isValid(const Entry& entry)
+    {
+        for (size_t i = 0; i < entry.searched; ++i) {
+            Directory& directory = directories_[i];
+            struct stat buf;
+            struct timespec mtime = { 0, 0 };
+            if (::stat(directory.name.c_str(), &buf) == 0) {
+                mtime = buf.st_mtim;
+            }
+            if (! isSameTime(mtime, directory.mtime)) {
+                directory.mtime = mtime;
+                for (EntriesType::iterator j = entries_.begin();
+                    j != entries_.end();)
+                {
+                    if (j->second.searched > i) {
+                        entries_.erase(j++);
+                    }
+                    else {
+                        ++j;
+                    }
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //
+    // Walk the PATH directories like execvp() does. Returns false if the
+    // result can not be cached because it depends on the current working
+    // directory.
+    //
+
+    bool PathCache::search(const std::string& name, Entry& entry) const
+    {
+        bool isCacheable = true;
+
+        entry.hits = 0;
+        entry.searched = directories_.size();
+        for (size_t i = 0; i < directories_.size(); ++i) {
+            const std::string& directory = directories_[i].name;
+            if (directory[0] != '/') {
+                isCacheable = false;
+            }
+
+            std::string path = directory + '/' + name;
+            struct stat buf;
+            if (::stat(path.c_str(), &buf) == 0 && S_ISREG(buf.st_mode) &&
+                ::access(path.c_str(), X_OK) == 0) {
+                entry.path = path;
+                entry.searched = i + 1;
+                break;
+            }
+        }
+        return isCacheable;
+    }
+}}
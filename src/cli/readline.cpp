@@ -225,6 +225,11 @@ namespace cli { namespace readline
     void Readline::inStream(std::istream& in)
     {
         in_ = &in;
+        if (readlineLibrary_ && ::fileno(in) < 0) {
+            // Streams without a descriptor, like string streams, are used
+            // without the library
+            readlineLibrary_.reset();
+        }
         if (readlineLibrary_) {
             readlineLibrary_->inStream(in);
             std::error_code errorCode = readlineLibrary_->lastError();
@@ -238,6 +243,9 @@ namespace cli { namespace readline
     void Readline::outStream(std::ostream& out)
     {
         out_ = &out;
+        if (readlineLibrary_ && ::fileno(out) < 0) {
+            readlineLibrary_.reset();
+        }
         if (readlineLibrary_) {
             readlineLibrary_->outStream(out);
             std::error_code errorCode = readlineLibrary_->lastError();
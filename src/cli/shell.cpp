@@ -18,15 +18,32 @@
 
 //#define BOOST_SPIRIT_DEBUG
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+#include <boost/bind/bind.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/fusion/adapted/struct/adapt_struct.hpp>
 #include <boost/fusion/include/adapt_struct.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/spirit/include/phoenix_bind.hpp>
 #include <boost/spirit/include/phoenix_container.hpp>
 #include <boost/spirit/include/phoenix_fusion.hpp>
+#include <boost/spirit/include/phoenix_object.hpp>
 #include <boost/spirit/include/phoenix_operator.hpp>
 #include <boost/spirit/include/phoenix_statement.hpp>
 
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
 #define translate(str) str  // TODO: Use Boost.Locale when available
 
 #include <cli/shell.hpp>
@@ -57,6 +74,27 @@ BOOST_FUSION_ADAPT_STRUCT(
     (cli::parser::shellparser::Arguments::TypeOfTerminator, terminator)
 )
 
+BOOST_FUSION_ADAPT_STRUCT(
+    cli::parser::shellparser::RawVariableAssignment,
+    (cli::parser::ParseString, name)
+    (cli::parser::shellparser::Word, value)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    cli::parser::shellparser::RawStdioRedirection,
+    (cli::parser::shellparser::StdioRedirection::TypeOfRedirection, type)
+    (cli::parser::shellparser::Word, argument)
+    (boost::iterator_range<std::string::const_iterator>, source)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    cli::parser::shellparser::RawArguments,
+    (cli::parser::shellparser::RawArguments::VariablesType, variables)
+    (cli::parser::shellparser::RawArguments::WordsType, words)
+    (cli::parser::shellparser::RawArguments::RedirectionsType, redirections)
+    (cli::parser::shellparser::Arguments::TypeOfTerminator, terminator)
+)
+
 namespace cli { namespace parser { namespace shellparser
 {
     namespace qi = boost::spirit::qi;
@@ -74,7 +112,8 @@ namespace cli { namespace parser { namespace shellparser
     template <typename Iterator>
     ShellParser<Iterator>::ShellParser(ShellInterpreter& interpreter)
         : ShellParser::base_type(start),
-          interpreter_(interpreter)
+          interpreter_(interpreter),
+          isLastCommandLiteral_(false)
     {
         using qi::_1;
         using qi::_2;
@@ -82,7 +121,6 @@ namespace cli { namespace parser { namespace shellparser
         using qi::_4;
         using qi::_a;
         using qi::_val;
-        using qi::_r1;
         using qi::eps;
         using qi::eoi;
         using qi::fail;
@@ -92,103 +130,113 @@ namespace cli { namespace parser { namespace shellparser
         using qi::raw;
         using iso8859_1::char_;
         using iso8859_1::space;
-        using phoenix::at;
         using phoenix::at_c;
         using phoenix::begin;
-        using phoenix::bind;
+        using phoenix::construct;
         using phoenix::empty;
         using phoenix::end;
         using phoenix::insert;
         using phoenix::push_back;
-        using phoenix::size;
 
         eol = eoi;
         neol = !eoi;
         character %= char_;
         dereference = '$';
         special %= dereference | redirectors | terminators | pipe;
-        escape %= '\\' > character;
+        escape = '\\' >> (
+            character [_val = _1] |
+            expected(translate("character"))
+        );
 
         name %= char_("a-zA-Z") >> *char_("a-zA-Z0-9");
+        parameter %= name | iso8859_1::string("?");
         variable =
             eps[_a = false] >>
             dereference >> (
-                -lit('{')[_a = true] >
-                name[_val = bind(
-                    &ShellInterpreter::variableLookup, interpreter_, _1)]
-            ) >> ((eps(_a) > '}') | eps(!_a));
+                -lit('{')[_a = true] >>
+                (parameter[_val = _1] | expected(translate("name")))
+            ) >> (
+                (eps(_a) >> (lit('}') | expected(translate("'}'")))) |
+                eps(!_a)
+            );
 
-        quotedString %= '\'' >> *(char_ - '\'') > '\'';
+        // Every alternative adds to the word only once it has matched, so
+        // nothing is left behind by the ones that fail halfway
+        quotedString %= '\'' >> *(char_ - '\'') >>
+            (lit('\'') | expected(translate("closing quote")));
         doubleQuotedString = '"' >> *(
-            variable                    [_val += _1] |
-            (
-                char_('\'')             [push_back(_val, _1)]  >>
-                *((char_ - '\'' - '"')  [push_back(_val, _1)]) >>
-                char_('\'')             [push_back(_val, _1)]
-            ) |
-            (char_ - '"')               [push_back(_val, _1)]
-        ) > '"';
+            variable
+                [phoenix::bind(&ShellParser::appendToWord, _val,
+                    WordPart::QUOTED_VARIABLE, _1)] |
+            raw[char_('\'') >> *(char_ - '\'' - '"') >> char_('\'')]
+                [phoenix::bind(&ShellParser::appendToWord, _val,
+                    WordPart::QUOTED_TEXT, construct<ParseString>(
+                        begin(_1), end(_1)))] |
+            (char_ - '"')
+                [phoenix::bind(&ShellParser::appendCharacterToWord, _val,
+                    WordPart::QUOTED_TEXT, _1)]
+        ) >> (lit('"') | expected(translate("closing double quote")));
 
         word = +(
-            variable                    [_val += _1]          |
+            variable
+                [phoenix::bind(&ShellParser::appendToWord, _val,
+                    WordPart::VARIABLE, _1)] |
             quotedString
-                [_val += bind(&ShellParser::globEscape, _1)]  |
+                [phoenix::bind(&ShellParser::appendToWord, _val,
+                    WordPart::QUOTED_TEXT, _1)] |
             doubleQuotedString
-                [_val += bind(&ShellParser::globEscape, _1)]  |
-            escape                      [push_back(_val, _1)] |
-            (char_ - space - special)   [push_back(_val, _1)]
+                [insert(_val, end(_val), begin(_1), end(_1))] |
+            escape
+                [phoenix::bind(&ShellParser::appendCharacterToWord, _val,
+                    WordPart::TEXT, _1)] |
+            (char_ - space - special)
+                [phoenix::bind(&ShellParser::appendCharacterToWord, _val,
+                    WordPart::TEXT, _1)]
         );
 
-        expandedWord = word
-            [_val = bind(
-                &ShellInterpreter::pathnameExpansion, interpreter_, _1)];
-
-        variableValue = expandedWord
-            [_val = bind(&ShellParser::stringsJoin, _1)];
-
-        unambiguousRedirection = eps(_r1);
-        redirectionArgument = (
-            (
-                &expandedWord[_a = size(_1)] >
-                unambiguousRedirection(_a == 1)
-
-            ) >> expandedWord[_val = at(_1, 0)]
-        ) | (eps > expandedWord);
-
-        assignment %= name >> '=' >> -variableValue;
-        redirection %= redirectors >> redirectionArgument;
+        assignment %= name >> '=' >> -word;
+        redirection =
+            redirectors [at_c<0>(_val) = _1] >> (
+                raw[word[at_c<1>(_val) = _1]]
+                        [at_c<2>(_val) = _1] |
+                expected(translate("word"))
+            );
 
+        // Every element is added on its own, because the vectors that +
+        // would build do not take their memory from the arena
         command = (
-            (+assignment)   [at_c<0>(_val) = _1] ||
-            (
-                +expandedWord
-                [insert(at_c<1>(_val), end(at_c<1>(_val)),
-                    begin(_1), end(_1))]
-            ) ||
-            (+redirection)  [at_c<2>(_val) = _1]
+            +assignment     [push_back(at_c<0>(_val), _1)] ||
+            +word           [push_back(at_c<1>(_val), _1)] ||
+            +redirection    [push_back(at_c<2>(_val), _1)]
         ) >> (
+            (conditionals   [at_c<3>(_val) = _1] >>
+                (neol | expected(translate("more characters")))) |
             (terminators    [at_c<3>(_val) = _1] >> -eol) |
-            (pipe           [at_c<3>(_val) = _1] >  neol) |
-            (eps > eol)
+            (pipe           [at_c<3>(_val) = _1] >>
+                (neol | expected(translate("more characters")))) |
+            (eol | expected(translate("end-of-line")))
         );
+
+        // Words are expanded once the command is known to be valid
         start = command [
-             at_c<1>(_val) = _1,
-             at_c<0>(_val) = bind(&Arguments::getCommandName, _1)
+             phoenix::bind(&ShellParser::expandArguments, this, _1,
+                 at_c<1>(_val)),
+             at_c<0>(_val) = phoenix::bind(&Arguments::getCommandName,
+                 at_c<1>(_val))
         ];
 
         character.name(translate("character"));
         name.name(translate("name"));
-        expandedWord.name(translate("word"));
-        variableValue.name(translate("word"));
-        unambiguousRedirection.name(translate("unambiguous redirection"));
+        parameter.name(translate("name"));
+        word.name(translate("word"));
         eol.name(translate("end-of-line"));
         neol.name(translate("more characters"));
 
 //      BOOST_SPIRIT_DEBUG_NODE(name);
+//      BOOST_SPIRIT_DEBUG_NODE(parameter);
 //      BOOST_SPIRIT_DEBUG_NODE(variable);
 //      BOOST_SPIRIT_DEBUG_NODE(quotedString);
 //      BOOST_SPIRIT_DEBUG_NODE(doubleQuotedString);
-//      BOOST_SPIRIT_DEBUG_NODE(expandedWord);
 //      BOOST_SPIRIT_DEBUG_NODE(word);
 //      BOOST_SPIRIT_DEBUG_NODE(assignment);
 //      BOOST_SPIRIT_DEBUG_NODE(redirection);
@@ -197,6 +245,239 @@ namespace cli { namespace parser { namespace shellparser
         BOOST_SPIRIT_DEBUG_NODE(start);
     }
 
+    //
+    // Flags used to expand pathname patterns
+    //
+
+    static glob::Glob::GlobFlags pathnameExpansionFlags()
+    {
+#if defined(_GNU_SOURCE)
+        return glob::Glob::EXPAND_BRACE_EXPRESSIONS |
+            glob::Glob::NO_PATH_NAMES_CHECK | glob::Glob::EXPAND_TILDE;
+#else
+        return glob::Glob::NO_PATH_NAMES_CHECK;
+#endif /* _GNU_SOURCE */
+    }
+
+    //
+    // Expand the words of a command that has been parsed, in the order
+    // they were written
+    //
+
+    template <typename Iterator>
+    void ShellParser<Iterator>::expandArguments(const RawArguments& raw,
+        Arguments& arguments)
+    {
+        // The words are expanded into vectors from the arena when they are
+        // not added to the arguments right away
+        typedef std::vector<std::string, ParseAllocator<std::string> >
+            WordsType;
+
+        // Commands that did not match as expected are reported as errors,
+        // so they are not worth expanding
+        if (this->hasExpectationFailure()) {
+            return;
+        }
+
+        isLastCommandLiteral_ = true;
+        for (RawArguments::VariablesType::const_iterator i =
+            raw.variables.begin(); i < raw.variables.end(); ++i)
+        {
+            VariableAssignment variable;
+            variable.name.assign(i->name.begin(), i->name.end());
+            if (! i->value.empty()) {
+                WordsType words;
+                expandWord(i->value, words);
+                variable.value = stringsJoin(words);
+            }
+            arguments.variables.push_back(variable);
+        }
+
+        for (RawArguments::WordsType::const_iterator i = raw.words.begin();
+            i < raw.words.end(); ++i)
+        {
+            expandWord(*i, arguments.arguments);
+        }
+
+        // The argument of every redirection is expanded once, and the same
+        // result is checked to be a single word and then used, instead of
+        // looking ahead with a first expansion
+        for (RawArguments::RedirectionsType::const_iterator i =
+            raw.redirections.begin(); i < raw.redirections.end(); ++i)
+        {
+            WordsType words;
+            expandWord(i->argument, words);
+            if (words.size() != 1) {
+                this->expectationFailure(i->source.begin(), i->source.end(),
+                    translate("unambiguous redirection"));
+                return;
+            }
+            StdioRedirection redirection;
+            redirection.type = i->type;
+            redirection.argument = words[0];
+            arguments.redirections.push_back(redirection);
+        }
+
+        arguments.terminator = raw.terminator;
+    }
+
+    //
+    // Look up the variables of the word and then expand it as a pathname
+    // pattern, adding the results to words. Quoted parts are escaped so
+    // they only match themselves.
+    //
+
+    template <typename Iterator>
+    template <typename Words>
+    void ShellParser<Iterator>::expandWord(const Word& word, Words& words)
+    {
+        ParseString pattern;
+        for (Word::const_iterator i = word.begin(); i < word.end(); ++i) {
+            std::string value;
+            switch (i->type) {
+            case WordPart::TEXT:
+                pattern += i->text;
+                break;
+            case WordPart::QUOTED_TEXT:
+                glob::Glob::appendEscaped(pattern, i->text.data(),
+                    i->text.data() + i->text.size());
+                break;
+            case WordPart::VARIABLE:
+                value = interpreter_.variableLookup(
+                    std::string(i->text.begin(), i->text.end()));
+                pattern.append(value.data(), value.size());
+                isLastCommandLiteral_ = false;
+                break;
+            case WordPart::QUOTED_VARIABLE:
+                value = interpreter_.variableLookup(
+                    std::string(i->text.begin(), i->text.end()));
+                glob::Glob::appendEscaped(pattern, value.data(),
+                    value.data() + value.size());
+                isLastCommandLiteral_ = false;
+                break;
+            }
+        }
+
+        // Most words are not patterns, so glob() would just return them
+        if (! interpreter_.onPathnameExpansion &&
+            ! glob::Glob::isPattern(pattern.c_str(),
+                pathnameExpansionFlags())) {
+            words.push_back(std::string(pattern.begin(), pattern.end()));
+            return;
+        }
+        isLastCommandLiteral_ = false;
+        std::vector<std::string> expanded = interpreter_.pathnameExpansion(
+            std::string(pattern.begin(), pattern.end()));
+        words.insert(words.end(), expanded.begin(), expanded.end());
+    }
+
+    template <typename Iterator>
+    bool ShellParser<Iterator>::isParseCacheEnabled() const
+    {
+        return ! interpreter_.onPathnameExpansion;
+    }
+
+    template <typename Iterator>
+    void ShellParser<Iterator>::appendToWord(Word& word,
+        WordPart::TypeOfPart type, const ParseString& text)
+    {
+        // Consecutive parts of the same type are merged, but variables
+        // have to be looked up one by one
+        if (! word.empty() && word.back().type == type &&
+            (type == WordPart::TEXT || type == WordPart::QUOTED_TEXT)) {
+            word.back().text += text;
+        }
+        else {
+            WordPart part;
+            part.type = type;
+            part.text = text;
+            word.push_back(part);
+        }
+    }
+
+    //
+    // Characters that send a line to the full grammar: the special ones,
+    // the ones that start quotes, escapes and expansions, and the 8-bit
+    // space of ISO-8859-1. Iterators must point to contiguous characters
+    // ended by a null one, like those of std::string, so strcspn() and
+    // strspn() can scan them many bytes at a time.
+    //
+
+    static const char* const fastPathRejectedCharacters =
+        "$<>;&|'\"\\*?[{~\xa0";
+    static const char* const fastPathSpaceCharacters = " \t\n\v\f\r";
+
+    template <typename Iterator>
+    bool ShellParser<Iterator>::parseSimpleCommand(Iterator& begin,
+        Iterator end, std::string& command, Arguments& arguments) const
+    {
+        interpreter_.viewedArguments_ = NULL;
+
+        // Globbing is done only when it may change a word
+        if (interpreter_.onPathnameExpansion) {
+            return false;
+        }
+
+        const char* first = &*begin;
+        const char* last = first + (end - begin);
+        if (first + std::strcspn(first, fastPathRejectedCharacters) < last) {
+            return false;
+        }
+
+        const char* current = first + std::strspn(first,
+            fastPathSpaceCharacters);
+        const char* wordEnd = std::min(last,
+            current + std::strcspn(current, fastPathSpaceCharacters));
+
+        // Assignments only may be at the beginning
+        if (current == last ||
+            std::find(current, wordEnd, '=') != wordEnd) {
+            return false;
+        }
+
+        // Builtins registered by onRunCommandView() get their words as
+        // views of the line. Only the name is copied, to run the command.
+        ArgumentsView& view = interpreter_.argumentsView_;
+        bool isViewed = ! interpreter_.isArgumentsViewInUse_ &&
+            interpreter_.runCommandViews_.find(std::string_view(current,
+                wordEnd - current)) != interpreter_.runCommandViews_.end();
+        if (isViewed) {
+            view.assign(std::string_view(first, last - first));
+        }
+
+        // The words of the previous command passed in by the interpreter
+        // are overwritten, to reuse the memory they already have
+        std::vector<std::string>& words = arguments.arguments;
+        size_t count = 0;
+        while (current < last) {
+            if (isViewed) {
+                view.addFromLine(current - first, wordEnd - current);
+            }
+            if (! isViewed || count == 0) {
+                if (count < words.size()) {
+                    words[count].assign(current, wordEnd);
+                }
+                else {
+                    words.push_back(std::string(current, wordEnd));
+                }
+            }
+            ++count;
+            current = wordEnd + std::strspn(wordEnd, fastPathSpaceCharacters);
+            wordEnd = std::min(last,
+                current + std::strcspn(current, fastPathSpaceCharacters));
+        }
+        words.resize(isViewed ? 1 : count);
+        if (isViewed) {
+            interpreter_.viewedArguments_ = &arguments;
+        }
+        arguments.variables.clear();
+        arguments.redirections.clear();
+        arguments.terminator = Arguments::NORMAL;
+        command = words[0];
+        begin = end;
+        return true;
+    }
+
     //
     // Explicit instantiations of ShellParser class
     //
@@ -206,6 +487,50 @@ namespace cli { namespace parser { namespace shellparser
 
 namespace cli
 {
+    //
+    // Functions to measure times
+    //
+
+    static double secondsBetween(const struct timespec& start,
+        const struct timespec& end)
+    {
+        return (end.tv_sec - start.tv_sec) +
+            (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+
+    static double secondsSince(const struct timespec& start)
+    {
+        struct timespec now;
+        ::clock_gettime(CLOCK_MONOTONIC, &now);
+        return secondsBetween(start, now);
+    }
+
+    static double timevalToSeconds(const struct timeval& time)
+    {
+        return time.tv_sec + time.tv_usec / 1e6;
+    }
+
+    //
+    // Class ScopeTimer
+    //
+    // Add the time spent in the scope of the object to an accumulator.
+    //
+
+    class ScopeTimer
+    {
+        public:
+            ScopeTimer(double& accumulator)
+                : accumulator_(accumulator)
+                { ::clock_gettime(CLOCK_MONOTONIC, &startTime_); }
+
+            ~ScopeTimer()
+                { accumulator_ += secondsSince(startTime_); }
+
+        private:
+            double& accumulator_;
+            struct timespec startTime_;
+    };
+
     //
     // Class ShellInterpreter
     //
@@ -215,17 +540,1250 @@ namespace cli
 
     ShellInterpreter::ShellInterpreter(bool useReadline)
         : BaseType(boost::shared_ptr<SpiritGrammarType>(
-            new SpiritGrammarType(*this)), useReadline)
-    {}
+            new SpiritGrammarType(*this)), useReadline),
+          launcher_(launcher::Launcher::create(
+            launcher::Launcher::POSIX_SPAWN)),
+          viewedArguments_(NULL),
+          isArgumentsViewInUse_(false),
+          jobPlacement_(NULL),
+          lastStatus_(0),
+          isSkipping_(false),
+          stageTimes_(NULL),
+          timedStage_(0),
+          expansionTime_(0.0)
+    {
+        launcher_->childSignalMask(jobs_.savedSignalMask());
+        ::clock_gettime(CLOCK_MONOTONIC, &parseStartTime_);
+        jobSlots(0);
+    }
 
     ShellInterpreter::ShellInterpreter(std::istream& in, std::ostream& out,
         std::ostream& err, bool useReadline)
         : BaseType(boost::shared_ptr<SpiritGrammarType>(
-            new SpiritGrammarType(*this)), in, out, err, useReadline)
-    {}
+            new SpiritGrammarType(*this)), in, out, err, useReadline),
+          launcher_(launcher::Launcher::create(
+            launcher::Launcher::POSIX_SPAWN)),
+          viewedArguments_(NULL),
+          isArgumentsViewInUse_(false),
+          jobPlacement_(NULL),
+          lastStatus_(0),
+          isSkipping_(false),
+          stageTimes_(NULL),
+          timedStage_(0),
+          expansionTime_(0.0)
+    {
+        launcher_->childSignalMask(jobs_.savedSignalMask());
+        ::clock_gettime(CLOCK_MONOTONIC, &parseStartTime_);
+        jobSlots(0);
+    }
+
+    void ShellInterpreter::launcherBackend(
+        launcher::Launcher::Backend backend)
+    {
+        launcher_ = launcher::Launcher::create(backend);
+        launcher_->childSignalMask(jobs_.savedSignalMask());
+    }
+
+    //
+    // Set the number of background jobs that can run at once. 0 means one
+    // per online CPU.
+    //
+
+    void ShellInterpreter::jobSlots(size_t slots)
+    {
+        if (slots == 0) {
+            long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+            slots = cpus > 0 ? cpus : 1;
+        }
+        jobSlots_ = slots;
+    }
+
+    //
+    // Set the default placement of the jobs. Its CPUs are kept in the order
+    // used to hand them out to the commands of a pipeline.
+    //
+
+    void ShellInterpreter::placement(const launcher::Placement& placement)
+    {
+        placement_ = placement;
+        launcher::sortCpusBySiblings(placement_.cpus);
+    }
+
+    size_t ShellInterpreter::runningBackgroundJobs() const
+    {
+        // Stopped jobs do not compete for the CPU, so they free their slot
+        size_t count = 0;
+        const jobs::JobTable::JobsType& table = jobs_.jobs();
+        for (jobs::JobTable::JobsType::const_iterator i = table.begin();
+            i != table.end(); ++i)
+        {
+            if (i->second.isBackground &&
+                i->second.state == jobs::Job::RUNNING) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    void ShellInterpreter::runQueuedJobs(bool waitForSlots)
+    {
+        // Starting a background job does not change $?
+        int lastStatus = lastStatus_;
+
+        jobs_.update();
+        while (! queuedJobs_.empty()) {
+            if (runningBackgroundJobs() < jobSlots_) {
+                startQueuedJob(queuedJobs_.front());
+                queuedJobs_.pop_front();
+            }
+            else if (! waitForSlots || ! jobs_.waitForChanges()) {
+                break;
+            }
+        }
+        lastStatus_ = lastStatus;
+    }
+
+    //
+    // Remember where and with which environment the job was queued. The
+    // words of the pipeline are already expanded, but a 'cd' or an 'export'
+    // run before it starts must not change what it sees.
+    //
+
+    void ShellInterpreter::queueJob(const PipelineType& pipeline)
+    {
+        QueuedJob job;
+        job.pipeline = pipeline;
+        job.workingDirectory = ::open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+        for (char** i = environ; *i != NULL; ++i) {
+            job.environment.push_back(*i);
+        }
+        queuedJobs_.push_back(job);
+    }
+
+    //
+    // Launch a queued job from its own working directory and environment,
+    // which every launcher and every child hook take from the interpreter
+    // process, and restore those of the interpreter afterwards
+    //
+
+    void ShellInterpreter::startQueuedJob(QueuedJob& job)
+    {
+        int workingDirectory = -1;
+        if (job.workingDirectory >= 0) {
+            workingDirectory = ::open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+            if (workingDirectory < 0 ||
+                ::fchdir(job.workingDirectory) < 0) {
+                errorStream() << cli::utility::programShortName()
+                              << ": "
+                              << translate("cannot restore the working "
+                                 "directory of a queued job")
+                              << std::endl;
+            }
+        }
+
+        cli::utility::ArgV environment(job.environment);
+        char** savedEnviron = environ;
+        environ = environment.get();
+        executePipeline(job.pipeline);
+        environ = savedEnviron;
+
+        if (workingDirectory >= 0) {
+            ::fchdir(workingDirectory);
+            ::close(workingDirectory);
+        }
+        if (job.workingDirectory >= 0) {
+            ::close(job.workingDirectory);
+            job.workingDirectory = -1;
+        }
+    }
+
+    //
+    // A script that ends while there are queued jobs has to start them,
+    // like the rest of its background jobs. They are discarded if the user
+    // leaves an interactive interpreter.
+    //
+
+    void ShellInterpreter::postLoop()
+    {
+        if (! queuedJobs_.empty() && ! jobs_.isJobControlEnabled()) {
+            runQueuedJobs(true);
+        }
+        if (onPostLoop) {
+            onPostLoop.call();
+        }
+    }
+
+    //
+    // Report the background jobs that have finished while the user was
+    // typing the command line
+    //
+
+    void ShellInterpreter::preRunCommand(std::string& line)
+    {
+        isSkipping_ = false;
+        ::clock_gettime(CLOCK_MONOTONIC, &parseStartTime_);
+        expansionTime_ = 0.0;
+
+        std::vector<jobs::Job> finished = jobs_.takeFinished();
+        for (std::vector<jobs::Job>::const_iterator i = finished.begin();
+            i < finished.end(); ++i)
+        {
+            errorStream() << '[' << i->id << "]  "
+                          << jobs::stateToString(*i) << "\t"
+                          << i->commandLine << std::endl;
+        }
+        runQueuedJobs();
+    }
+
+    //
+    // Run the pipeline unless the && or || before it says otherwise, and
+    // decide from its terminator and the resulting status whether the
+    // next one has to run
+    //
+
+    bool ShellInterpreter::runPipeline(const PipelineType& pipeline)
+    {
+        bool isFinished = false;
+        if (isSkipping_) {
+            // Nothing to do
+        }
+        else if (pipeline.back().arguments.terminator ==
+            ShellArguments::BACKGROUNDED &&
+            (! queuedJobs_.empty() || runningBackgroundJobs() >= jobSlots_)) {
+            // Jobs start in the order they were queued
+            queueJob(pipeline);
+            runQueuedJobs();
+            if (! queuedJobs_.empty()) {
+                errorStream() << "[-]  "
+                              << translate("Queued")
+                              << "\t"
+                              << pipelineToString(pipeline)
+                              << std::endl;
+            }
+            lastStatus_ = 0;
+        }
+        else {
+            isFinished = executePipeline(pipeline);
+        }
+
+        switch (pipeline.back().arguments.terminator) {
+        case ShellArguments::AND:
+            isSkipping_ = lastStatus_ != 0;
+            break;
+        case ShellArguments::OR:
+            isSkipping_ = lastStatus_ == 0;
+            break;
+        default:
+            isSkipping_ = false;
+            break;
+        }
+
+        // The next pipeline is parsed from here
+        ::clock_gettime(CLOCK_MONOTONIC, &parseStartTime_);
+        expansionTime_ = 0.0;
+        return isFinished;
+    }
+
+    //
+    // Run the pipeline as its first word says: measured by 'time', split by
+    // 'batch', placed by 'place' or just launched
+    //
+
+    bool ShellInterpreter::executePipeline(const PipelineType& pipeline)
+    {
+        const std::string& name = pipeline.front().name;
+        if (name == "time") {
+            return timePipeline(pipeline);
+        }
+        else if (name == "batch") {
+            return batchPipeline(pipeline);
+        }
+        else if (name == "place") {
+            return placePipeline(pipeline);
+        }
+        return launchPipeline(pipeline);
+    }
+
+    //
+    // Convert a status returned by waitpid() to the exit status of the shell
+    //
+
+    static int waitStatusToExitStatus(int status)
+    {
+        if (WIFEXITED(status)) {
+            return WEXITSTATUS(status);
+        }
+        else if (WIFSIGNALED(status)) {
+            return 128 + WTERMSIG(status);
+        }
+        else if (WIFSTOPPED(status)) {
+            return 128 + WSTOPSIG(status);
+        }
+        return 0;
+    }
+
+    //
+    // Run the pipeline without its 'time' prefix and report the measures
+    // of every command
+    //
+
+    bool ShellInterpreter::timePipeline(const PipelineType& pipeline)
+    {
+        struct timespec startTime;
+        ::clock_gettime(CLOCK_MONOTONIC, &startTime);
+        double expansionTime = expansionTime_;
+        double parseTime =
+            secondsBetween(parseStartTime_, startTime) - expansionTime;
+
+        PipelineType timedPipeline;
+        std::vector<StageTimes> stages(pipeline.size());
+        for (size_t i = 0; i < pipeline.size(); ++i) {
+            PipelineType::Command& command = timedPipeline.add();
+            command = pipeline.commands()[i];
+            if (i == 0) {
+                command.arguments.arguments.erase(
+                    command.arguments.arguments.begin());
+                command.name = command.arguments.getCommandName();
+            }
+            stages[i].commandLine =
+                boost::algorithm::join(command.arguments.arguments, " ");
+            stages[i].pid = -1;
+            stages[i].startTime = startTime;
+            stages[i].realTime = -1.0;
+        }
+
+        stageTimes_ = &stages;
+        bool isFinished = timedPipeline.front().name == "time" ?
+            launchPipeline(timedPipeline) : executePipeline(timedPipeline);
+        stageTimes_ = NULL;
+
+        reportTimes(stages, secondsSince(startTime), parseTime,
+            expansionTime);
+        return isFinished;
+    }
+
+    //
+    // Bytes taken by a string in the memory block of arguments and
+    // environment passed to execve(), including the pointer to it
+    //
+
+    static size_t execStringSize(const std::string& string)
+    {
+        return string.size() + 1 + sizeof(char*);
+    }
+
+    //
+    // Remove from the table the jobs in ids that have finished, setting
+    // status to the exit status of the last one that failed. Returns how
+    // many jobs are left in ids.
+    //
+
+    static size_t removeFinishedJobs(jobs::JobTable& jobs,
+        std::vector<int>& ids, int& status)
+    {
+        for (std::vector<int>::iterator i = ids.begin(); i < ids.end();) {
+            jobs::Job* job = jobs.find(*i);
+            if (job != NULL && job->state != jobs::Job::DONE) {
+                ++i;
+                continue;
+            }
+            if (job != NULL) {
+                int jobStatus = waitStatusToExitStatus(job->status);
+                if (jobStatus != 0) {
+                    status = jobStatus;
+                }
+                jobs.remove(*job);
+            }
+            i = ids.erase(i);
+        }
+        return ids.size();
+    }
+
+    //
+    // Run the command that follows 'batch' as many times as needed to pass
+    // it every argument without exceeding ARG_MAX
+    //
+
+    bool ShellInterpreter::batchPipeline(const PipelineType& pipeline)
+    {
+        const ShellArguments& batchArguments = pipeline.front().arguments;
+        const std::vector<std::string>& words = batchArguments.arguments;
+
+        // Like xargs, the number of jobs may be given as -P n or -Pn
+        size_t parallelism = 1;
+        size_t first = 1;
+        bool isValid = true;
+        if (words.size() > 1 && words[1].compare(0, 2, "-P") == 0) {
+            const char* jobs;
+            if (words[1].size() > 2) {
+                jobs = words[1].c_str() + 2;
+                first = 2;
+            }
+            else {
+                jobs = words.size() > 2 ? words[2].c_str() : "";
+                first = 3;
+            }
+            char* end;
+            errno = 0;
+            long n = std::strtol(jobs, &end, 10);
+            isValid = *jobs >= '0' && *jobs <= '9' && *end == '\0' &&
+                errno == 0;
+            if (isValid) {
+                long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+                parallelism = n > 0 ? n : (cpus > 0 ? cpus : 1);
+            }
+        }
+        if (! isValid || first >= words.size() || pipeline.size() > 1 ||
+            batchArguments.terminator == ShellArguments::BACKGROUNDED) {
+            errorStream() << cli::utility::programShortName()
+                          << ": batch: "
+                          << translate("usage: batch [-P jobs] command "
+                               "[arguments...], without pipes or '&'")
+                          << std::endl;
+            lastStatus_ = 2;
+            return false;
+        }
+
+        // The command and its options are repeated in every batch
+        size_t fixed = first + 1;
+        while (fixed < words.size() && words[fixed].size() > 1 &&
+            words[fixed][0] == '-') {
+            if (words[fixed++] == "--") {
+                break;
+            }
+        }
+
+        // Like xargs, leave some room for the process to grow its
+        // environment before calling exec()
+        long argMax = ::sysconf(_SC_ARG_MAX);
+        size_t available = argMax > 0 ? argMax : _POSIX_ARG_MAX;
+        size_t used = 2048;
+        for (char** i = environ; *i != NULL; ++i) {
+            used += std::strlen(*i) + 1 + sizeof(char*);
+        }
+        for (std::vector<VariableAssignment>::const_iterator i =
+            batchArguments.variables.begin();
+            i < batchArguments.variables.end(); ++i)
+        {
+            used += execStringSize(i->name + '=' + i->value);
+        }
+        for (size_t i = first; i < fixed; ++i) {
+            used += execStringSize(words[i]);
+        }
+        if (used >= available) {
+            errorStream() << cli::utility::programShortName()
+                          << ": batch: "
+                          << words[first]
+                          << ": "
+                          << std::strerror(E2BIG)
+                          << std::endl;
+            lastStatus_ = 126;
+            return false;
+        }
+
+        // Split the rest of the words
+        std::vector<ShellArguments> batches;
+        size_t batchSize = 0;
+        for (size_t i = fixed; i < words.size() || batches.empty(); ++i) {
+            size_t size = i < words.size() ? execStringSize(words[i]) : 0;
+            if (batches.empty() || (batchSize + size > available - used &&
+                batches.back().arguments.size() > fixed - first)) {
+                // Only the fixed words are copied, not the whole list
+                batches.push_back(ShellArguments());
+                ShellArguments& batch = batches.back();
+                batch.variables = batchArguments.variables;
+                batch.arguments.assign(words.begin() + first,
+                    words.begin() + fixed);
+                batch.redirections = batchArguments.redirections;
+                batchSize = 0;
+            }
+            if (i < words.size()) {
+                batches.back().arguments.push_back(words[i]);
+                batchSize += size;
+            }
+        }
+
+        // Every batch adds its output to the files truncated here, because
+        // batches run in parallel may open them in any order
+        if (batches.size() > 1) {
+            for (std::vector<StdioRedirection>::const_iterator i =
+                batchArguments.redirections.begin();
+                i < batchArguments.redirections.end(); ++i)
+            {
+                if (i->type != StdioRedirection::TRUNCATED_OUTPUT) {
+                    continue;
+                }
+                int fd = ::open(i->argument.c_str(),
+                    O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0666);
+                if (fd < 0) {
+                    errorStream() << cli::utility::programShortName()
+                                  << ": "
+                                  << i->argument
+                                  << ": "
+                                  << std::strerror(errno)
+                                  << std::endl;
+                    lastStatus_ = 1;
+                    return false;
+                }
+                ::close(fd);
+            }
+            for (std::vector<ShellArguments>::iterator i = batches.begin();
+                i < batches.end(); ++i)
+            {
+                for (std::vector<StdioRedirection>::iterator j =
+                    i->redirections.begin(); j < i->redirections.end(); ++j)
+                {
+                    if (j->type == StdioRedirection::TRUNCATED_OUTPUT) {
+                        j->type = StdioRedirection::APPENDED_OUTPUT;
+                    }
+                }
+            }
+        }
+
+        const std::string& command = words[first];
+        int status = 0;
+        bool isFinished = false;
+
+        // Callbacks can not be run in parallel because they may run in the
+        // interpreter process
+        if (parallelism == 1 || batches.size() == 1 ||
+            onRunCommand.isDefined(command)) {
+            for (std::vector<ShellArguments>::const_iterator i =
+                batches.begin(); i < batches.end() && ! isFinished; ++i)
+            {
+                PipelineType batchPipeline;
+                PipelineType::Command& batchCommand = batchPipeline.add();
+                batchCommand.name = command;
+                batchCommand.arguments = *i;
+                isFinished = launchPipeline(batchPipeline);
+                if (lastStatus_ != 0) {
+                    status = lastStatus_;
+                }
+            }
+            lastStatus_ = status;
+            return isFinished;
+        }
+
+        outputStream().flush();
+        errorStream().flush();
+
+        // Every batch is a job of its own, so a batch that finishes does not
+        // leave the process group of the others without a leader. Stopped
+        // batches are left in the job table.
+        std::vector<int> running;
+        std::vector<int> noPipes;
+        for (size_t i = 0; i < batches.size(); ++i) {
+            while (removeFinishedJobs(jobs_, running, status) >=
+                parallelism && jobs_.waitForChanges()) {}
+
+            launcher::SpawnRequest request;
+            request.processGroup = jobs_.isJobControlEnabled() ? 0 : -1;
+            request.placement = jobPlacement();
+            int spawnStatus;
+            pid_t pid = spawnCommand(command, batches[i], noPipes, request,
+                spawnStatus);
+            if (pid < 0) {
+                status = spawnStatus;
+                continue;
+            }
+
+            // The whole list of arguments is too long to be shown
+            const std::vector<std::string>& arguments = batches[i].arguments;
+            std::string commandLine = boost::algorithm::join(
+                std::vector<std::string>(arguments.begin(),
+                    arguments.begin() + std::min<size_t>(arguments.size(),
+                        fixed - first + 1)), " ") + " ...";
+            jobs::Job& job = jobs_.add(pid, request.processGroup == 0 ?
+                pid : -1, commandLine);
+            job.placement = request.placement.toString();
+            running.push_back(job.id);
+        }
+        while (removeFinishedJobs(jobs_, running, status) > 0 &&
+            jobs_.waitForChanges()) {}
+
+        lastStatus_ = status;
+        return false;
+    }
+
+    //
+    // Run the pipeline without its 'place' options, with the CPU affinity,
+    // nice value and scheduling policy they set
+    //
+
+    bool ShellInterpreter::placePipeline(const PipelineType& pipeline)
+    {
+        const std::vector<std::string>& words =
+            pipeline.front().arguments.arguments;
+
+        launcher::Placement placement = jobPlacement();
+        size_t first = 1;
+        bool isValid = true;
+        while (isValid && first + 1 < words.size() &&
+            words[first].size() == 2 && words[first][0] == '-') {
+            const std::string& value = words[first + 1];
+            switch (words[first][1]) {
+            case 'c':
+                isValid = launcher::Placement::stringToCpus(value,
+                    placement.cpus);
+                launcher::sortCpusBySiblings(placement.cpus);
+                break;
+            case 'n':
+                isValid = launcher::Placement::stringToNiceness(value,
+                    placement.niceness);
+                placement.isNicenessSet = true;
+                break;
+            case 's':
+                isValid = launcher::Placement::stringToPolicy(value,
+                    placement.policy);
+                break;
+            default:
+                isValid = false;
+                break;
+            }
+            first += 2;
+        }
+        if (! isValid || first >= words.size()) {
+            errorStream() << cli::utility::programShortName()
+                          << ": place: "
+                          << translate("usage: place [-c cpus] [-n nice] "
+                               "[-s other|batch|idle] command [arguments...]")
+                          << std::endl;
+            lastStatus_ = 2;
+            return false;
+        }
+
+        PipelineType placedPipeline;
+        for (size_t i = 0; i < pipeline.size(); ++i) {
+            PipelineType::Command& command = placedPipeline.add();
+            command = pipeline.commands()[i];
+            if (i == 0) {
+                command.arguments.arguments.erase(
+                    command.arguments.arguments.begin(),
+                    command.arguments.arguments.begin() + first);
+                command.name = command.arguments.getCommandName();
+            }
+        }
+
+        const launcher::Placement* savedPlacement = jobPlacement_;
+        jobPlacement_ = &placement;
+        bool isFinished = placedPipeline.front().name == "place" ?
+            launchPipeline(placedPipeline) : executePipeline(placedPipeline);
+        jobPlacement_ = savedPlacement;
+        return isFinished;
+    }
+
+    void ShellInterpreter::reportTimes(const std::vector<StageTimes>& stages,
+        double realTime, double parseTime, double expansionTime)
+    {
+        std::ostream& err = errorStream();
+        std::ios_base::fmtflags flags = err.flags();
+        std::streamsize precision = err.precision();
+        err << std::fixed << std::setprecision(3);
+
+        double userTime = 0.0;
+        double systemTime = 0.0;
+        double spawnTime = 0.0;
+        for (std::vector<StageTimes>::const_iterator i = stages.begin();
+            i < stages.end(); ++i)
+        {
+            userTime += timevalToSeconds(i->usage.ru_utime);
+            systemTime += timevalToSeconds(i->usage.ru_stime);
+            spawnTime += i->spawnTime;
+        }
+
+        err << std::endl
+            << "real\t" << realTime << std::endl
+            << "user\t" << userTime << std::endl
+            << "sys\t" << systemTime << std::endl
+            << std::endl
+            << "stage\treal\tuser\tsys\tmaxrss\tvcsw\tivcsw\tspawn\t"
+               "command" << std::endl;
+        for (size_t i = 0; i < stages.size(); ++i) {
+            const StageTimes& stage = stages[i];
+            err << i + 1 << '\t';
+            if (stage.realTime < 0.0) {
+                err << "-\t-\t-\t-\t-\t-\t";
+            }
+            else {
+                err << stage.realTime << '\t'
+                    << timevalToSeconds(stage.usage.ru_utime) << '\t'
+                    << timevalToSeconds(stage.usage.ru_stime) << '\t'
+                    << stage.usage.ru_maxrss << "k\t"
+                    << stage.usage.ru_nvcsw << '\t'
+                    << stage.usage.ru_nivcsw << '\t';
+            }
+            // Expansions may produce command lines of any length
+            err << std::setprecision(6) << stage.spawnTime << '\t'
+                << std::setprecision(3)
+                << (stage.commandLine.size() > 64 ?
+                    stage.commandLine.substr(0, 61) + "..." :
+                    stage.commandLine)
+                << std::endl;
+        }
+
+        err << std::endl << std::setprecision(6)
+            << "shell\tparse " << parseTime
+            << "\texpansion " << expansionTime
+            << "\tspawn " << spawnTime << std::endl;
+
+        err.flags(flags);
+        err.precision(precision);
+    }
+
+    //
+    // Run the commands of a pipeline. Every pipe is created before the first
+    // command is launched and all the processes join the same process
+    // group, so the whole pipeline is waited for once as a single job.
+    //
+
+    bool ShellInterpreter::launchPipeline(const PipelineType& pipeline)
+    {
+        typedef PipelineType::CommandsType CommandsType;
+
+        const CommandsType& commands = pipeline.commands();
+        const ShellArguments& lastArguments = pipeline.back().arguments;
+        bool isBackground =
+            lastArguments.terminator == ShellArguments::BACKGROUNDED;
+        bool isSingleCommand = commands.size() == 1 && ! isBackground &&
+            lastArguments.redirections.empty();
+
+        // Commands implemented by callbacks run in the interpreter process
+        // when their standard I/O does not need to be changed
+        if (isSingleCommand && ! lastArguments.arguments.empty() &&
+            onRunCommand.isDefined(pipeline.back().name)) {
+            lastStatus_ = 0;
+            timedStage_ = 0;
+            return runCommand(pipeline.back().name, lastArguments);
+        }
+
+        // The last builtin of a foreground pipeline runs in the interpreter
+        // too, once every other command has been started. The rest of them
+        // are forked, because a builtin run in the interpreter may block
+        // writing to a pipe that nobody reads yet.
+        size_t builtinIndex = commands.size();
+        if (! isBackground) {
+            for (size_t i = commands.size(); i > 0; --i) {
+                if (! commands[i - 1].arguments.arguments.empty() &&
+                    onRunCommand.isBuiltin(commands[i - 1].name)) {
+                    builtinIndex = i - 1;
+                    break;
+                }
+            }
+        }
+
+        // Nothing is left to do after the last command of a script, so it
+        // does not need a process of its own
+        if (commands.size() == 1 && ! isBackground && isLastPipeline() &&
+            ! lastArguments.arguments.empty() &&
+            ! onRunCommand.isDefined(pipeline.back().name) &&
+            ! jobs_.isJobControlEnabled() && stageTimes_ == NULL &&
+            queuedJobs_.empty() && ! onPostLoop) {
+            execCommand(pipeline.back().name, lastArguments);
+            return false;
+        }
+
+        // A line with assignments alone sets the variables of the
+        // interpreter, which are exported to every child
+        if (isSingleCommand && lastArguments.arguments.empty()) {
+            const std::vector<VariableAssignment>& variables =
+                lastArguments.variables;
+            for (std::vector<VariableAssignment>::const_iterator i =
+                variables.begin(); i < variables.end(); ++i)
+            {
+                ::setenv(i->name.c_str(), i->value.c_str(), 1);
+            }
+            lastStatus_ = 0;
+            return false;
+        }
+
+        std::vector<int> pipes(2 * (commands.size() - 1), -1);
+        for (size_t i = 0; i < pipes.size(); i += 2) {
+            if (::pipe2(&pipes[i], O_CLOEXEC) < 0) {
+                errorStream() << cli::utility::programShortName()
+                              << ": pipe: "
+                              << std::strerror(errno)
+                              << std::endl;
+                for (size_t j = 0; j < i; ++j) {
+                    ::close(pipes[j]);
+                }
+                lastStatus_ = 1;
+                return false;
+            }
+        }
+
+        // The children must not inherit data pending to be written
+        outputStream().flush();
+        errorStream().flush();
+
+        // Status of the last command if it was not launched as a process of
+        // the job: a builtin run in the interpreter or a failed launch
+        int launchStatus = -1;
+
+        // Every command of a pipeline gets a CPU of its own, if there are
+        // enough, next to the ones of the commands it is connected to
+        const launcher::Placement& placement = jobPlacement();
+        bool isPinnedByCommand =
+            commands.size() > 1 && placement.cpus.size() > 1;
+        launcher::Placement usedPlacement = placement;
+        if (isPinnedByCommand && usedPlacement.cpus.size() > commands.size()) {
+            usedPlacement.cpus.resize(commands.size());
+        }
+
+        jobs::Job* job = NULL;
+        pid_t processGroup = jobs_.isJobControlEnabled() ? 0 : -1;
+        for (size_t i = 0; i < commands.size(); ++i) {
+            const std::string& command = commands[i].name;
+            const ShellArguments& arguments = commands[i].arguments;
+            if (i == builtinIndex) {
+                continue;
+            }
+
+            launcher::SpawnRequest request;
+            request.processGroup = processGroup;
+            request.placement = placement;
+            if (isPinnedByCommand) {
+                request.placement.cpus.assign(1,
+                    placement.cpus[i % placement.cpus.size()]);
+            }
+            if (i > 0) {
+                request.fileActions.addDup2(pipes[2 * i - 2], 0);
+            }
+            if (i < commands.size() - 1) {
+                request.fileActions.addDup2(pipes[2 * i + 1], 1);
+            }
+
+            struct timespec spawnStartTime;
+            ::clock_gettime(CLOCK_MONOTONIC, &spawnStartTime);
+            int status;
+            pid_t pid = spawnCommand(command, arguments, pipes, request,
+                status);
+            if (stageTimes_ != NULL) {
+                StageTimes& stage = (*stageTimes_)[i];
+                stage.pid = pid;
+                stage.startTime = spawnStartTime;
+                stage.spawnTime = secondsSince(spawnStartTime);
+            }
+            if (pid < 0) {
+                if (i == commands.size() - 1) {
+                    launchStatus = status;
+                }
+                continue;
+            }
+
+            std::string commandLine =
+                boost::algorithm::join(arguments.arguments, " ");
+            if (job == NULL) {
+                if (processGroup == 0) {
+                    processGroup = pid;
+                }
+                job = &jobs_.add(pid, processGroup, commandLine);
+                job->placement = usedPlacement.toString();
+            }
+            else {
+                jobs_.addProcess(*job, pid, commandLine);
+            }
+        }
+
+        bool isFinished = false;
+        if (builtinIndex < commands.size()) {
+            int input = builtinIndex > 0 ?
+                pipes[2 * builtinIndex - 2] : -1;
+            int output = builtinIndex < commands.size() - 1 ?
+                pipes[2 * builtinIndex + 1] : -1;
+            lastStatus_ = 0;
+            timedStage_ = builtinIndex;
+            isFinished = runBuiltin(commands[builtinIndex].name,
+                commands[builtinIndex].arguments, input, output, pipes);
+            if (builtinIndex == commands.size() - 1) {
+                launchStatus = lastStatus_;
+            }
+        }
+        else {
+            for (std::vector<int>::const_iterator i = pipes.begin();
+                i < pipes.end(); ++i)
+            {
+                ::close(*i);
+            }
+        }
+
+        if (job == NULL) {
+            lastStatus_ = launchStatus >= 0 ? launchStatus : 0;
+            return isFinished;
+        }
+
+        if (isBackground) {
+            job->isBackground = true;
+            errorStream() << '[' << job->id << "] " << job->pid()
+                          << std::endl;
+            lastStatus_ = 0;
+        }
+        else {
+            int id = job->id;
+            jobs::Job finished;
+            int status = jobs_.foreground(*job, false,
+                stageTimes_ != NULL ? &finished : NULL);
+            if (stageTimes_ != NULL) {
+                std::vector<StageTimes>& stages = *stageTimes_;
+                for (std::vector<jobs::Job::Process>::const_iterator i =
+                    finished.processes.begin();
+                    i < finished.processes.end(); ++i)
+                {
+                    for (std::vector<StageTimes>::iterator j =
+                        stages.begin(); j < stages.end(); ++j)
+                    {
+                        if (j->pid == i->pid) {
+                            j->realTime =
+                                secondsBetween(j->startTime, i->endTime);
+                            j->usage = i->usage;
+                        }
+                    }
+                }
+            }
+            lastStatus_ = launchStatus >= 0 ? launchStatus :
+                waitStatusToExitStatus(status);
+            job = jobs_.find(id);
+            if (job != NULL && job->state == jobs::Job::STOPPED) {
+                lastStatus_ = 128 + SIGTSTP;
+                errorStream() << std::endl
+                              << '[' << job->id << "]+  "
+                              << jobs::stateToString(*job) << "\t"
+                              << job->commandLine << std::endl;
+            }
+        }
+        return isFinished;
+    }
+
+    //
+    // Value of the last PATH assigned before the command, or NULL if it
+    // does not set one
+    //
+
+    static const std::string* pathAssignment(ShellArguments const& arguments)
+    {
+        const std::string* value = NULL;
+        for (std::vector<VariableAssignment>::const_iterator i =
+            arguments.variables.begin(); i < arguments.variables.end(); ++i)
+        {
+            if (i->name == "PATH") {
+                value = &i->value;
+            }
+        }
+        return value;
+    }
+
+    //
+    // Fill request to run a command once the caller has set up its process
+    // group and pipes. Commands implemented by callbacks run in a copy of
+    // the interpreter, where every descriptor in pipes has to be closed.
+    // Returns false if the program was not found.
+    //
+
+    bool ShellInterpreter::prepareSpawnRequest(const std::string& command,
+        ShellArguments const& arguments, const std::vector<int>& pipes,
+        launcher::SpawnRequest& request)
+    {
+        stdioRedirectionsToFileActions(arguments.redirections,
+            request.fileActions);
+
+        if (! arguments.arguments.empty() &&
+            onRunCommand.isDefined(command)) {
+            // Without exec() the pipes are not closed in the child
+            for (std::vector<int>::const_iterator i = pipes.begin();
+                i < pipes.end(); ++i)
+            {
+                request.fileActions.addClose(*i);
+            }
+            request.childHook = boost::bind(
+                &ShellInterpreter::runCommandInChild, this,
+                boost::cref(command), boost::cref(arguments));
+        }
+        else {
+            // Assignments before the command only apply to it. So does a
+            // PATH among them, which is searched without the cache.
+            environment_.clear();
+            for (std::vector<VariableAssignment>::const_iterator i =
+                arguments.variables.begin();
+                i < arguments.variables.end(); ++i)
+            {
+                environment_.set(i->name, i->value);
+            }
+            request.environment = environment_.envp();
+
+            const std::string* pathVariable = pathAssignment(arguments);
+            request.arguments = arguments.arguments;
+            if (! request.arguments.empty() && ! (pathVariable != NULL ?
+                launcher::PathCache::lookup(request.arguments[0],
+                    *pathVariable, request.path) :
+                pathCache_.lookup(request.arguments[0], request.path))) {
+                errorStream() << cli::utility::programShortName()
+                              << ": "
+                              << request.arguments[0]
+                              << ": "
+                              << translate("command not found")
+                              << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //
+    // Launch a command once the caller has set up the process group and the
+    // pipes of request. Returns the PID of the child or -1, after reporting
+    // why it could not be launched and setting status to the exit status
+    // for that failure.
+    //
+
+    pid_t ShellInterpreter::spawnCommand(const std::string& command,
+        ShellArguments const& arguments, const std::vector<int>& pipes,
+        launcher::SpawnRequest& request, int& status)
+    {
+        if (! prepareSpawnRequest(command, arguments, pipes, request)) {
+            status = 127;
+            return -1;
+        }
+
+        pid_t pid = launcher_->spawn(request);
+        if (pid < 0 && launcher_->lastError().value() == ENOENT &&
+            ! request.path.empty() && pathAssignment(arguments) == NULL) {
+            // The program was removed after it was cached
+            pathCache_.forget(request.arguments[0]);
+            if (pathCache_.lookup(request.arguments[0], request.path)) {
+                pid = launcher_->spawn(request);
+            }
+        }
+        if (pid < 0) {
+            errorStream() << cli::utility::programShortName()
+                          << ": "
+                          << command
+                          << ": "
+                          << launcher_->lastError().message()
+                          << std::endl;
+            status = 126;
+        }
+        return pid;
+    }
+
+    //
+    // Run the last command of the input in place of the interpreter, like
+    // other shells do, saving the creation of one process. It only returns
+    // if the command could not be run.
+    //
+
+    void ShellInterpreter::execCommand(const std::string& command,
+        ShellArguments const& arguments)
+    {
+        launcher::SpawnRequest request;
+        request.placement = jobPlacement();
+        if (! prepareSpawnRequest(command, arguments, std::vector<int>(),
+            request)) {
+            lastStatus_ = 127;
+            return;
+        }
+
+        // Nothing is written by the interpreter after exec()
+        outputStream().flush();
+        errorStream().flush();
+
+        launcher_->exec(request);
+        errorStream() << cli::utility::programShortName()
+                      << ": "
+                      << command
+                      << ": "
+                      << launcher_->lastError().message()
+                      << std::endl;
+        lastStatus_ = launcher_->lastError().value() == ENOENT ? 127 : 126;
+    }
+
+    //
+    // Run a builtin in the interpreter process. Its standard I/O is moved to
+    // input, output and the files of its redirections with dup2(), and
+    // restored when it returns. Every descriptor in pipes is closed before
+    // the builtin runs, so the other commands of the pipeline see the end of
+    // their pipes as soon as it finishes.
+    //
+
+    bool ShellInterpreter::runBuiltin(const std::string& command,
+        ShellArguments const& arguments, int input, int output,
+        const std::vector<int>& pipes)
+    {
+        outputStream().flush();
+        errorStream().flush();
+
+        int savedInput = ::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        int savedOutput = ::fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+
+        launcher::FileActions fileActions;
+        if (input >= 0) {
+            fileActions.addDup2(input, STDIN_FILENO);
+        }
+        if (output >= 0) {
+            fileActions.addDup2(output, STDOUT_FILENO);
+        }
+        for (std::vector<int>::const_iterator i = pipes.begin();
+            i < pipes.end(); ++i)
+        {
+            fileActions.addClose(*i);
+        }
+        stdioRedirectionsToFileActions(arguments.redirections, fileActions);
+        int error = launcher::applyFileActions(fileActions);
+
+        bool isFinished = false;
+        if (error) {
+            errorStream() << cli::utility::programShortName()
+                          << ": "
+                          << command
+                          << ": "
+                          << std::strerror(error)
+                          << std::endl;
+            for (std::vector<int>::const_iterator i = pipes.begin();
+                i < pipes.end(); ++i)
+            {
+                ::close(*i);
+            }
+        }
+        else {
+            // A closed pipe must not kill the interpreter
+            struct sigaction action, oldAction;
+            action.sa_handler = SIG_IGN;
+            ::sigemptyset(&action.sa_mask);
+            action.sa_flags = 0;
+            ::sigaction(SIGPIPE, &action, &oldAction);
+
+            isFinished = runCommand(command, arguments);
+            outputStream().flush();
+            errorStream().flush();
+
+            ::sigaction(SIGPIPE, &oldAction, NULL);
+        }
+
+        if (savedInput >= 0) {
+            ::dup2(savedInput, STDIN_FILENO);
+            ::close(savedInput);
+        }
+        else {
+            ::close(STDIN_FILENO);
+        }
+        if (savedOutput >= 0) {
+            ::dup2(savedOutput, STDOUT_FILENO);
+            ::close(savedOutput);
+        }
+        else {
+            ::close(STDOUT_FILENO);
+        }
+
+        // Writing to a closed pipe leaves the streams in a failed state
+        outputStream().clear();
+        errorStream().clear();
+        return isFinished;
+    }
+
+    //
+    // Run a command implemented by a callback. If it runs in the interpreter
+    // while a pipeline is timed, its resource usage is measured too.
+    //
+
+    bool ShellInterpreter::runCommand(const std::string& command,
+        ShellArguments const& arguments)
+    {
+        if (stageTimes_ == NULL) {
+            return BaseType::runCommand(command, arguments);
+        }
+
+        StageTimes& stage = (*stageTimes_)[timedStage_];
+        struct rusage startUsage, endUsage;
+        ::getrusage(RUSAGE_SELF, &startUsage);
+        ::clock_gettime(CLOCK_MONOTONIC, &stage.startTime);
+
+        bool isFinished = BaseType::runCommand(command, arguments);
+
+        stage.realTime = secondsSince(stage.startTime);
+        ::getrusage(RUSAGE_SELF, &endUsage);
+        timersub(&endUsage.ru_utime, &startUsage.ru_utime,
+            &stage.usage.ru_utime);
+        timersub(&endUsage.ru_stime, &startUsage.ru_stime,
+            &stage.usage.ru_stime);
+        stage.usage.ru_maxrss = endUsage.ru_maxrss;
+        stage.usage.ru_nvcsw = endUsage.ru_nvcsw - startUsage.ru_nvcsw;
+        stage.usage.ru_nivcsw = endUsage.ru_nivcsw - startUsage.ru_nivcsw;
+        return isFinished;
+    }
+
+    void ShellInterpreter::onRunCommandView(const std::string& command,
+        const RunCommandViewType& callback)
+    {
+        runCommandViews_[command] = callback;
+        onRunCommand(command, boost::bind(&ShellInterpreter::runCommandView,
+            this, boost::placeholders::_1, boost::placeholders::_2), true);
+    }
+
+    //
+    // Run a builtin registered by onRunCommandView(). The words of the
+    // commands not taken by the fast path are copied to the view from the
+    // strings of the parser. A command run from the callback of another one
+    // gets a view of its own, because the outer one may still be reading
+    // argumentsView_.
+    //
+
+    bool ShellInterpreter::runCommandView(const std::string& command,
+        ShellArguments const& arguments)
+    {
+        RunCommandViewsType::const_iterator callback =
+            runCommandViews_.find(command);
+
+        ArgumentsView nestedView;
+        ArgumentsView& view = isArgumentsViewInUse_ ?
+            nestedView : argumentsView_;
+        if (&arguments != viewedArguments_) {
+            view.assign(std::string_view());
+            for (std::vector<std::string>::const_iterator i =
+                arguments.arguments.begin();
+                i < arguments.arguments.end(); ++i)
+            {
+                view.addCopy(*i);
+            }
+        }
+        viewedArguments_ = NULL;
+
+        bool wasInUse = isArgumentsViewInUse_;
+        isArgumentsViewInUse_ = true;
+        bool isFinished = callback->second(command, view);
+        isArgumentsViewInUse_ = wasInUse;
+        return isFinished;
+    }
+
+    //
+    // Run a command implemented by a callback in a child process, once its
+    // standard I/O has been set up
+    //
+
+    void ShellInterpreter::runCommandInChild(const std::string& command,
+        ShellArguments const& arguments)
+    {
+        // The environment of the child is not shared with the interpreter
+        for (std::vector<VariableAssignment>::const_iterator i =
+            arguments.variables.begin(); i < arguments.variables.end(); ++i)
+        {
+            ::setenv(i->name.c_str(), i->value.c_str(), 1);
+        }
+        // The measures are taken by the interpreter from the wait4() result
+        stageTimes_ = NULL;
+        lastStatus_ = 0;
+        runCommand(command, arguments);
+        outputStream().flush();
+        errorStream().flush();
+        ::_exit(lastStatus_);
+    }
 
     std::string ShellInterpreter::variableLookup(const std::string& name)
     {
+        ScopeTimer timer(expansionTime_);
+        if (isSkipping_) {
+            return std::string();
+        }
+        else if (name == "?") {
+            return boost::lexical_cast<std::string>(lastStatus_);
+        }
         return onVariableLookup ?
             onVariableLookup.call(name) : std::string();
     }
@@ -233,18 +1791,17 @@ namespace cli
     std::vector<std::string> ShellInterpreter::pathnameExpansion(
         const std::string& pattern)
     {
-        if (onPathnameExpansion) {
+        ScopeTimer timer(expansionTime_);
+        if (isSkipping_) {
+            return std::vector<std::string>(1, pattern);
+        }
+        else if (onPathnameExpansion) {
             return onPathnameExpansion.call(pattern);
         }
 
         using namespace glob;
 
-#if defined(_GNU_SOURCE)
-        Glob glob(pattern, Glob::EXPAND_BRACE_EXPRESSIONS |
-            Glob::NO_PATH_NAMES_CHECK | Glob::EXPAND_TILDE);
-#else
-        Glob glob(pattern, Glob::NO_PATH_NAMES_CHECK);
-#endif /* _GNU_SOURCE */
+        Glob glob(pattern, shellparser::pathnameExpansionFlags());
 
         Glob::ErrorsType errors = glob.errors();
         for (Glob::ErrorsType::const_iterator i = errors.begin();
@@ -262,4 +1819,42 @@ namespace cli
 
         return glob;
     }
+
+    std::string pipelineToString(
+        const ShellInterpreter::PipelineType& pipeline)
+    {
+        std::string commandLine;
+        for (ShellInterpreter::PipelineType::CommandsType::const_iterator i =
+            pipeline.commands().begin(); i < pipeline.commands().end(); ++i)
+        {
+            if (! commandLine.empty()) {
+                commandLine += " | ";
+            }
+            commandLine += boost::algorithm::join(i->arguments.arguments, " ");
+        }
+        return commandLine;
+    }
+
+    void stdioRedirectionsToFileActions(
+        const std::vector<StdioRedirection>& redirections,
+        launcher::FileActions& fileActions)
+    {
+        for (std::vector<StdioRedirection>::const_iterator i =
+            redirections.begin(); i < redirections.end(); ++i)
+        {
+            switch (i->type) {
+            case StdioRedirection::INPUT:
+                fileActions.addOpen(0, i->argument, O_RDONLY);
+                break;
+            case StdioRedirection::TRUNCATED_OUTPUT:
+                fileActions.addOpen(1, i->argument,
+                    O_CREAT | O_TRUNC | O_WRONLY);
+                break;
+            case StdioRedirection::APPENDED_OUTPUT:
+                fileActions.addOpen(1, i->argument,
+                    O_CREAT | O_APPEND | O_WRONLY);
+                break;
+            }
+        }
+    }
 }
@@ -29,12 +29,13 @@ namespace cli { namespace parser { namespace simpleparser
         std::string& arguments, std::string& error)
     {
         std::string::const_iterator i = find(begin, end, ' ');
-        command = std::string(begin, i);
+        // assign() reuses the memory of the previous command
+        command.assign(begin, i);
         if (i == end) {
             arguments.clear();
         }
         else {
-            arguments = std::string(i + 1, end);
+            arguments.assign(i + 1, end);
         }
         begin = end;
 
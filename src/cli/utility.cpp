@@ -23,6 +23,7 @@
 #include <ios>
 #include <locale>
 #include <string>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
 
@@ -86,6 +87,34 @@ namespace cli { namespace utility
             deleteArgV);
     }
 
+    //
+    // Class ArgV
+    //
+
+    void ArgV::assign(const std::vector<std::string>& strings)
+    {
+        size_ = strings.size();
+
+        size_t pointersSize = (size_ + 1) * sizeof(char*);
+        size_t bufferSize = pointersSize;
+        for (std::vector<std::string>::const_iterator i = strings.begin();
+            i < strings.end(); ++i)
+        {
+            bufferSize += i->size() + 1;
+        }
+        buffer_.resize(bufferSize);
+
+        char** argv = reinterpret_cast<char**>(&buffer_[0]);
+        char* p = &buffer_[pointersSize];
+        for (size_t i = 0; i < size_; ++i) {
+            const std::string& string = strings[i];
+            argv[i] = p;
+            std::memcpy(p, string.c_str(), string.size() + 1);
+            p += string.size() + 1;
+        }
+        argv[size_] = NULL;
+    }
+
 namespace detail
 {
     bool isCharNoSpace(char c)
@@ -108,4 +137,14 @@ namespace detail
         }
         return false;
     }
+
+    bool isStreamRegularFile(const std::ios& stream)
+    {
+        struct stat buf;
+        int fd = ::fileno(stream);
+        if (fd >= 0 && ::fstat(fd, &buf) == 0) {
+            return S_ISREG(buf.st_mode);
+        }
+        return false;
+    }
 }}}
@@ -55,6 +55,7 @@ namespace cli { namespace parser { namespace wordsparser
         using qi::eoi;
         using qi::fail;
         using qi::lexeme;
+        using qi::lit;
         using qi::on_error;
         using iso8859_1::char_;
         using iso8859_1::space;
@@ -63,13 +64,19 @@ namespace cli { namespace parser { namespace wordsparser
 
         eol = eoi;
         character %= char_;
-        escape %= '\\' > character;
+        escape = '\\' >> (
+            character [_val = _1] |
+            expected(translate("character"))
+        );
         word %= lexeme[+(escape | (char_ - space))];
-        quotedString %= lexeme['\'' >> *(char_ - '\'') > '\''];
-        doubleQuotedString %= lexeme['"' >> *(char_ - '"') > '"'];
+        quotedString %= lexeme['\'' >> *(char_ - '\'') >>
+            (lit('\'') | expected(translate("closing quote")))];
+        doubleQuotedString %= lexeme['"' >> *(char_ - '"') >>
+            (lit('"') | expected(translate("closing double quote")))];
         argument %= quotedString | doubleQuotedString | word;
         start = (+argument) [at_c<1>(_val) = _1,
-                             at_c<0>(_val) = at(_1, 0)] > eol;
+                             at_c<0>(_val) = at(_1, 0)] >>
+            (eol | expected(translate("end-of-line")));
 
         character.name(translate("character"));
         eol.name(translate("end-of-line"));
@@ -32,15 +32,26 @@
  * 	- Comando test
  */
 
+#include <charconv>
 #include <iostream>
 #include <string>
+#include <string_view>
 
+#include <boost/algorithm/string/join.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <cli/argumentsview.hpp>
 #include <cli/callbacks.hpp>
+#include <cli/jobs.hpp>
+#include <cli/launcher.hpp>
 #include <cli/prettyprint.hpp>
 #include <cli/shell.hpp>
 #include <cli/utility.hpp>
 
+#include <ctype.h>      // isdigit(), isspace()
 #include <errno.h>      // errno
+#include <limits.h>     // INT_MAX, PATH_MAX
 #include <fcntl.h>      // open()
 #include <stdlib.h>     // exit(), setenv(), ...
 #include <string.h>     // strerror()
@@ -57,8 +68,7 @@ const char INTRO_TEXT[] = "\x1b[2J\x1b[H"
 
 const char PROMPT_TEXT[] = "$ ";
 
-// Variable externa usada para el pipe
-int aux = 0;
+using namespace boost::placeholders;
 
 //
 // Function to be invoked by the interpreter when the user inputs the
@@ -80,120 +90,80 @@ bool onExit(const std::string& command, cli::ShellArguments const& arguments)
 
 bool onEcho(const std::string& command, cli::ShellArguments const& arguments)
 {
-        int pipeFileDes[2] = {-1, -1};
-    
-    if (arguments.terminator == cli::ShellArguments::PIPED)
-      pipe(pipeFileDes);
-    
-    pid_t childPid = fork();
-    if (childPid == 0) {            // Proceso hijo
-      if (aux > 0) {
-			dup2(aux,0);	// duplicamos para poder cerrarlo después
-			close(aux);
-      }	
-      if (arguments.terminator == cli::ShellArguments::PIPED) {
-			close (pipeFileDes[0]);
-			dup2(pipeFileDes[1], 1);
-			close (pipeFileDes[1]);
-      }
-      for (unsigned i = 0; i < arguments.redirections.size(); ++i){
-            int fd = -1;
-            int mode = S_IRUSR | S_IWUSR |      // u+rw
-                       S_IRGRP | S_IWGRP |      // g+rw
-                       S_IROTH | S_IWOTH;       // o+rw
-  		if (arguments.redirections[i].type ==
-                	cli::StdioRedirection::TRUNCATED_OUTPUT) {
-                	fd = open(arguments.redirections[i].argument.c_str(),
-                   	 O_CREAT | O_TRUNC | O_WRONLY, mode);
-                	if (fd >= 0) {
-                   		dup2(fd, 1);    // El fd 1 se cierra antes de duplicar
-                    		close(fd);
-                	}
-            	}
-		if (arguments.redirections[i].type ==
-                	cli::StdioRedirection::APPENDED_OUTPUT) {
-                	fd = open(arguments.redirections[i].argument.c_str(),
-                   	 O_CREAT | O_APPEND | O_WRONLY, mode);
-                	if (fd >= 0) {
-                   		dup2(fd, 1);    // El fd 1 se cierra antes de duplicar
-                    		close(fd);
-                	}
-            	}
-		if (arguments.redirections[i].type ==
-                	cli::StdioRedirection::INPUT) {
-                	fd = open(arguments.redirections[i].argument.c_str(),
-                   	 O_RDONLY, mode);
-                	if (fd >= 0) {
-                   		dup2(fd, 0);    // El fd 1 se cierra antes de duplicar
-                    		close(fd);
-                	}
-            	}
-		if (fd < 0) {
-                std::cerr << program_invocation_short_name
-                          << ": open: "
-                          << strerror(errno)
-                          << std::endl;
-                exit(1);
-            	}
-      }
-      if (! arguments.arguments.empty()) {
-            // Ejecutar el programa indicado en la línea de comandos.
-            // Usamos execvp() para que el programa sea buscado en el PATH
-           if (arguments.arguments.size() < 2) {
-	      std::cout << std::endl;
-	      return false;
-	    }
-
-	  std::cout << arguments.arguments[1];
-	  for (unsigned i = 2; i < arguments.arguments.size(); ++i) {
-	    std::cout << ' ';
-	    std::cout << arguments.arguments[i];
-	  }
-	  std::cout << std::endl;
-      }
-      exit(0);
-    }
-    else {			    // Proceso padre
-  	// Si no se quiso lanzar en background (terminador '&') esperar a que el
-    	// proceso hijo termine
-	if (childPid > 0 ) {
-		if (arguments.terminator == cli::ShellArguments::PIPED) {
-			close(pipeFileDes[1]);
-			aux = pipeFileDes[0];
-		}
-		if (arguments.terminator == cli::ShellArguments::NORMAL) {
-			waitpid(childPid, NULL, 0);
-		}
-    	}
-    	else {
-       	 std::cerr << program_invocation_short_name
-                  << ": fork: "
-                  << strerror(errno)
-                  << std::endl;
-    	}
-    	// Espera no bloqueante para recuperar la información acerca de los hijos
-    	// evitando la aparición de procesos zombi.
-    	while(waitpid(-1, NULL, WNOHANG) > 0);
-    	return false;
+    // El intérprete ya ha conectado la entrada y la salida estándar a las
+    // tuberías y redirecciones indicadas en la línea de comandos
+    for (unsigned i = 1; i < arguments.arguments.size(); ++i) {
+      if (i > 1)
+        std::cout << ' ';
+      std::cout << arguments.arguments[i];
     }
+    std::cout << std::endl;
     return false;
 }
 
-bool onCd(const std::string& command, cli::ShellArguments const& arguments)
+bool onCd(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ShellArguments const& arguments)
 {
-    char** path =  cli::utility::stdVectorStringToArgV(arguments.arguments);
-    chdir(path[1]);
+    // cd sin argumentos cambia al directorio personal del usuario
+    const char* path = arguments.arguments.size() < 2 ?
+      getenv("HOME") : arguments.arguments[1].c_str();
+    if (path != NULL && chdir(path) < 0) {
+      std::cerr << "cd: " << path << ": " << strerror(errno) << std::endl;
+      // Así 'cd dir && comando' no ejecuta el comando en otro directorio
+      interpreter.lastStatus(1);
+    }
     return false;
 }
 
-bool onKill(const std::string& command, cli::ShellArguments const& arguments)
+// Convierte una palabra en número como atoi(), pero sin que tenga que
+// terminar en nulo, así sirve para los argumentos de cli::ArgumentsView
+int viewToInt(std::string_view word)
+{
+    const char* first = word.data();
+    const char* last = first + word.size();
+    while (first < last && isspace(*first))
+      ++first;
+    if (last - first > 1 && *first == '+' && isdigit(first[1]))
+      ++first;
+    int value = 0;
+    std::from_chars(first, last, value);
+    return value;
+}
+
+// Copia una palabra en buffer terminada en nulo, para pasarla a stat() sin
+// reservar memoria. Si no cabe se usa la cadena vacía, con la que falla.
+const char* terminated(std::string_view word, char (&buffer)[PATH_MAX])
+{
+    if (word.size() >= sizeof(buffer))
+      return "";
+    word.copy(buffer, word.size());
+    buffer[word.size()] = '\0';
+    return buffer;
+}
+
+// Envía la señal a un trabajo (%n) o a un proceso. Para los procesos de la
+// tabla de trabajos se usa su pidfd, así no se mata a otro proceso que
+// hubiera reutilizado el pid
+int killTarget(cli::ShellInterpreter& interpreter, std::string_view spec,
+    int senal)
+{
+    cli::jobs::JobTable& jobs = interpreter.jobs();
+    if (! spec.empty() && spec[0] == '%') {
+      cli::jobs::Job* job = jobs.find(viewToInt(spec.substr(1)));
+      return job == NULL ? ESRCH : jobs.signal(*job, senal);
+    }
+    return jobs.signal(viewToInt(spec), senal);
+}
+
+bool onKill(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ArgumentsView const& arguments)
 {
     using namespace cli::prettyprint;
     
-    if (arguments.arguments.size() < 2) {
+    if (arguments.size() < 2) {
 	      std::cout << std::endl;
-	      std::cout << "Uso: kill pid" << std::endl;
-	      std::cout << "Uso: kill [-s numero_señal] pid" << std::endl;
+	      std::cout << "Uso: kill pid|%trabajo" << std::endl;
+	      std::cout << "Uso: kill [-s numero_señal] pid|%trabajo" << std::endl;
 	      std::cout << std::endl;
 	      std::cout << "----------------------LISTADO DE SEÑALES----------------------" << std::endl;
 	      std::cout << std::endl;
@@ -216,27 +186,43 @@ bool onKill(const std::string& command, cli::ShellArguments const& arguments)
 	      std::cout << std::endl;
 	      return false;
     }
-    else if (arguments.arguments.size() == 2) {
-      int pid = atoi(arguments.arguments[1].c_str());
-      std::cout << "Matamos el proceso con pid: " << pid << std::endl;
-      kill(pid, SIGTERM);
+    std::string_view spec;
+    int senal = SIGTERM;
+    if (arguments.size() == 2) {
+      spec = arguments[1];
+      std::cout << "Matamos el proceso con pid: " << spec << std::endl;
     }
     
-    else if (arguments.arguments.size() == 4) {
-      if (strcmp(arguments.arguments[1].c_str(),"-s") == 0){
-	int senal = atoi(arguments.arguments[2].c_str());
-	int pid = atoi(arguments.arguments[3].c_str());
-	kill(pid, senal);
+    else if (arguments.size() == 4) {
+      if (arguments[1] == "-s"){
+	senal = viewToInt(arguments[2]);
+	spec = arguments[3];
+      }
+    }
+
+    if (! spec.empty()) {
+      int error = killTarget(interpreter, spec, senal);
+      if (error) {
+        std::cerr << "kill: " << spec << ": " << strerror(error) << std::endl;
+        interpreter.lastStatus(1);
       }
     }
     return false;
 }
 
-bool onTest(const std::string& command, cli::ShellArguments const& arguments)
+bool onTest(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ArgumentsView const& arguments)
 {
     using namespace cli::prettyprint;
+
+    // Estado de salida: 0 si la expresión es verdadera, 1 si es falsa y 2 si
+    // no se entiende, así 'test -f fichero && orden' funciona como en sh
+    int status = 2;
+
+    // Rutas de los ficheros comprobados, terminadas en nulo
+    char path[PATH_MAX], path2[PATH_MAX];
     
-    if (arguments.arguments.size() < 2) {
+    if (arguments.size() < 2) {
       std::cout << "-----------------------------------Comando Test--------------------------------------" << std::endl;
       std::cout << "Uso: test expresion... (Usar espacios entre elementos de las expresiones)" << std::endl;
       std::cout << std::endl;
@@ -272,225 +258,267 @@ bool onTest(const std::string& command, cli::ShellArguments const& arguments)
       std::cout << std::endl;
     }
     
-    if (arguments.arguments.size() == 3) {//EMPIEZA 2 ARGUMENTOS
+    if (arguments.size() == 3) {//EMPIEZA 2 ARGUMENTOS
       
-       if (strcmp(arguments.arguments[1].c_str(),"-n") == 0){
-	 if (strlen(arguments.arguments[2].c_str()) != 0)
-	    std::cout << "TRUE" << std::endl;
+       if (arguments[1] == "-n"){
+	 if (! arguments[2].empty())
+	    { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	    std::cout << "FALSE" << std::endl;
+	    { std::cout << "FALSE" << std::endl; status = 1; }
       }
-       else if (strcmp(arguments.arguments[1].c_str(),"-z") == 0){
-	 if (strlen(arguments.arguments[1].c_str()) == 0)
-	    std::cout << "TRUE" << std::endl;
+       else if (arguments[1] == "-z"){
+	 if (arguments[2].empty())
+	    { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	    std::cout << "FALSE" << std::endl;
+	    { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-b") == 0){
+       else if (arguments[1] == "-b"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISBLK(buf.st_mode)) 
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISBLK(buf.st_mode)) 
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-c") == 0){
+       else if (arguments[1] == "-c"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISCHR(buf.st_mode))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISCHR(buf.st_mode))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-d") == 0){
+       else if (arguments[1] == "-d"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISDIR(buf.st_mode))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISDIR(buf.st_mode))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-e") == 0){
+       else if (arguments[1] == "-e"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1)
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1)
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-f") == 0){
+       else if (arguments[1] == "-f"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISREG(buf.st_mode))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISREG(buf.st_mode))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-g") == 0){
+       else if (arguments[1] == "-g"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (buf.st_mode & S_ISGID))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (buf.st_mode & S_ISGID))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-h") == 0){
+       else if (arguments[1] == "-h"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (S_ISLNK(buf.st_mode))) 
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (S_ISLNK(buf.st_mode))) 
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-L") == 0){
+       else if (arguments[1] == "-L"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISLNK(buf.st_mode)) 
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISLNK(buf.st_mode)) 
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-p") == 0){
+       else if (arguments[1] == "-p"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISFIFO(buf.st_mode)) 
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISFIFO(buf.st_mode)) 
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-r") == 0){
+       else if (arguments[1] == "-r"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (buf.st_mode & S_IRUSR))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (buf.st_mode & S_IRUSR))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-s") == 0){
+       else if (arguments[1] == "-s"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && buf.st_size > 0)
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && buf.st_size > 0)
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-S") == 0){
+       else if (arguments[1] == "-S"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && S_ISSOCK(buf.st_mode)) 
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && S_ISSOCK(buf.st_mode)) 
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-k") == 0){
+       else if (arguments[1] == "-k"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (buf.st_mode & S_ISVTX))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (buf.st_mode & S_ISVTX))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl; 
+	   { std::cout << "FALSE" << std::endl; status = 1; } 
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-u") == 0){
+       else if (arguments[1] == "-u"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (buf.st_mode & S_ISUID))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (buf.st_mode & S_ISUID))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-w") == 0){
+       else if (arguments[1] == "-w"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (buf.st_mode & S_IWUSR))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (buf.st_mode & S_IWUSR))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
-       else if (strcmp(arguments.arguments[1].c_str(),"-x") == 0){
+       else if (arguments[1] == "-x"){
 	 struct stat buf;
-	 if (stat(arguments.arguments[2].c_str(),&buf) != -1 && (buf.st_mode & S_IXUSR))
-	   std::cout << "TRUE" << std::endl;
+	 if (stat(terminated(arguments[2], path),&buf) != -1 && (buf.st_mode & S_IXUSR))
+	   { std::cout << "TRUE" << std::endl; status = 0; }
 	 else
-	   std::cout << "FALSE" << std::endl;
+	   { std::cout << "FALSE" << std::endl; status = 1; }
        }
     }//TERMINA 2 ARGUMENTOS
     
-    if (arguments.arguments.size() == 4) {//EMPIEZA 3 ARGUMENTOS
-      if (strcmp(arguments.arguments[2].c_str(),"=") == 0){
-	if (strcmp(arguments.arguments[1].c_str(),arguments.arguments[3].c_str()) == 0)
-		      std::cout << "TRUE" << std::endl;
+    if (arguments.size() == 4) {//EMPIEZA 3 ARGUMENTOS
+      if (arguments[2] == "="){
+	if (arguments[1] == arguments[3])
+		      { std::cout << "TRUE" << std::endl; status = 0; }
 		    else
-		      std::cout << "FALSE" << std::endl;
+		      { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"!=") == 0){
-	if (strcmp(arguments.arguments[1].c_str(),arguments.arguments[3].c_str()) != 0)
-		      std::cout << "TRUE" << std::endl;
+      else if (arguments[2] == "!="){
+	if (arguments[1] != arguments[3])
+		      { std::cout << "TRUE" << std::endl; status = 0; }
 		    else
-		      std::cout << "FALSE" << std::endl;
+		      { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-eq") == 0){
-	int num1 = atoi(arguments.arguments[1].c_str());
-	int num2 = atoi(arguments.arguments[3].c_str());
+      else if (arguments[2] == "-eq"){
+	int num1 = viewToInt(arguments[1]);
+	int num2 = viewToInt(arguments[3]);
 	if (num1 == num2)
-	  std::cout << "TRUE" << std::endl;
+	  { std::cout << "TRUE" << std::endl; status = 0; }
 	else
-	  std::cout << "FALSE" << std::endl;
+	  { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-ge") == 0){
-	int num1 = atoi(arguments.arguments[1].c_str());
-	int num2 = atoi(arguments.arguments[3].c_str());
+      else if (arguments[2] == "-ge"){
+	int num1 = viewToInt(arguments[1]);
+	int num2 = viewToInt(arguments[3]);
 	if (num1 >= num2)
-	  std::cout << "TRUE" << std::endl;
+	  { std::cout << "TRUE" << std::endl; status = 0; }
 	else
-	  std::cout << "FALSE" << std::endl;
+	  { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-gt") == 0){
-	int num1 = atoi(arguments.arguments[1].c_str());
-	int num2 = atoi(arguments.arguments[3].c_str());
+      else if (arguments[2] == "-gt"){
+	int num1 = viewToInt(arguments[1]);
+	int num2 = viewToInt(arguments[3]);
 	if (num1 > num2)
-	  std::cout << "TRUE" << std::endl;
+	  { std::cout << "TRUE" << std::endl; status = 0; }
 	else
-	  std::cout << "FALSE" << std::endl;
+	  { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-le") == 0){
-	int num1 = atoi(arguments.arguments[1].c_str());
-	int num2 = atoi(arguments.arguments[3].c_str());
+      else if (arguments[2] == "-le"){
+	int num1 = viewToInt(arguments[1]);
+	int num2 = viewToInt(arguments[3]);
 	if (num1 <= num2)
-	  std::cout << "TRUE" << std::endl;
+	  { std::cout << "TRUE" << std::endl; status = 0; }
 	else
-	  std::cout << "FALSE" << std::endl;
+	  { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-lt") == 0){
-	int num1 = atoi(arguments.arguments[1].c_str());
-	int num2 = atoi(arguments.arguments[3].c_str());
+      else if (arguments[2] == "-lt"){
+	int num1 = viewToInt(arguments[1]);
+	int num2 = viewToInt(arguments[3]);
 	if (num1 < num2)
-	  std::cout << "TRUE" << std::endl;
+	  { std::cout << "TRUE" << std::endl; status = 0; }
 	else
-	  std::cout << "FALSE" << std::endl;
+	  { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-ne") == 0){
-	int num1 = atoi(arguments.arguments[1].c_str());
-	int num2 = atoi(arguments.arguments[3].c_str());
+      else if (arguments[2] == "-ne"){
+	int num1 = viewToInt(arguments[1]);
+	int num2 = viewToInt(arguments[3]);
 	if (num1 != num2)
-	  std::cout << "TRUE" << std::endl;
+	  { std::cout << "TRUE" << std::endl; status = 0; }
 	else
-	  std::cout << "FALSE" << std::endl;
+	  { std::cout << "FALSE" << std::endl; status = 1; }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-ef") == 0){
+      else if (arguments[2] == "-ef"){
 	 struct stat buf,buf2;
-	 if (stat(arguments.arguments[1].c_str(),&buf) != -1 && stat(arguments.arguments[3].c_str(),&buf2) != -1){
+	 status = 1;
+	 if (stat(terminated(arguments[1], path),&buf) != -1 && stat(terminated(arguments[3], path2),&buf2) != -1){
 	   if (buf.st_ino == buf2.st_ino && buf.st_dev == buf2.st_dev){
-	      std::cout << "TRUE" << std::endl;
+	      { std::cout << "TRUE" << std::endl; status = 0; }
 	   }
 	   else{
-	      std::cout << "FALSE" << std::endl;
+	      { std::cout << "FALSE" << std::endl; status = 1; }
 	   }
 	 }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-nt") == 0){
+      else if (arguments[2] == "-nt"){
 	struct stat buf,buf2;
-	 if (stat(arguments.arguments[1].c_str(),&buf) != -1 && stat(arguments.arguments[3].c_str(),&buf2) != -1){
+	 status = 1;
+	 if (stat(terminated(arguments[1], path),&buf) != -1 && stat(terminated(arguments[3], path2),&buf2) != -1){
 	   if (buf.st_mtime >= buf2.st_mtime)
-	      std::cout << "TRUE" << std::endl;
+	      { std::cout << "TRUE" << std::endl; status = 0; }
 	   else
-	      std::cout << "FALSE" << std::endl;
+	      { std::cout << "FALSE" << std::endl; status = 1; }
 	 }
       }
-      else if (strcmp(arguments.arguments[2].c_str(),"-ot") == 0){
+      else if (arguments[2] == "-ot"){
 	struct stat buf,buf2;
-	 if (stat(arguments.arguments[1].c_str(),&buf) != -1 && stat(arguments.arguments[3].c_str(),&buf2) != -1){
+	 status = 1;
+	 if (stat(terminated(arguments[1], path),&buf) != -1 && stat(terminated(arguments[3], path2),&buf2) != -1){
 	   if (buf.st_mtime <= buf2.st_mtime)
-	      std::cout << "TRUE" << std::endl;
+	      { std::cout << "TRUE" << std::endl; status = 0; }
 	   else
-	      std::cout << "FALSE" << std::endl;
+	      { std::cout << "FALSE" << std::endl; status = 1; }
 	}
       }
     }//TERMINA 3 ARGUMENTOS
+    interpreter.lastStatus(status);
+    return false;
+}
+
+bool onHash(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ShellArguments const& arguments)
+{
+    cli::launcher::PathCache& cache = interpreter.pathCache();
+
+    // hash: muestra las rutas recordadas y cuántas veces se han usado
+    if (arguments.arguments.size() < 2) {
+      const cli::launcher::PathCache::EntriesType& entries = cache.entries();
+      if (entries.empty()) {
+        std::cout << "hash: hash table empty" << std::endl;
+        return false;
+      }
+      std::cout << "hits\tcommand" << std::endl;
+      for (cli::launcher::PathCache::EntriesType::const_iterator i =
+          entries.begin(); i != entries.end(); ++i) {
+        if (! i->second.path.empty())
+          std::cout << "   " << i->second.hits << "\t" << i->second.path
+                    << std::endl;
+      }
+      return false;
+    }
+
+    // hash -r: olvida todas las rutas
+    if (arguments.arguments[1] == "-r") {
+      cache.clear();
+      return false;
+    }
+
+    // hash nombre...: busca y recuerda cada nombre
+    for (unsigned i = 1; i < arguments.arguments.size(); ++i) {
+      std::string path;
+      if (! cache.lookup(arguments.arguments[i], path))
+        std::cerr << "hash: " << arguments.arguments[i] << ": not found"
+                  << std::endl;
+    }
     return false;
 }
 
@@ -539,127 +567,247 @@ bool onTest(const std::string& command, cli::ShellArguments const& arguments)
 //    };
 */
 
-bool onOtherCommand(const std::string& command,
+//
+// Devuelve el trabajo indicado en el argumento index como %n o como PID,
+// o el trabajo actual si no se indicó ninguno
+//
+
+cli::jobs::Job* findJob(cli::ShellInterpreter& interpreter,
+    cli::ShellArguments const& arguments, unsigned index)
+{
+    cli::jobs::JobTable& jobs = interpreter.jobs();
+    if (arguments.arguments.size() <= index)
+      return jobs.current();
+
+    const std::string& spec = arguments.arguments[index];
+    if (! spec.empty() && spec[0] == '%')
+      return jobs.find(atoi(spec.c_str() + 1));
+    return jobs.findByPid(atoi(spec.c_str()));
+}
+
+bool onJobs(cli::ShellInterpreter& interpreter, const std::string& command,
     cli::ShellArguments const& arguments)
 {
-    using namespace cli::prettyprint;
+    cli::jobs::JobTable& jobs = interpreter.jobs();
+    jobs.update();
 
-    /*std::cout << prettyprint;
-    std::cout << "command:   " << command << std::endl;
-    std::cout << "arguments: " << arguments << std::endl;
-    std::cout << "------------------------" << std::endl;
-    std::cout << noprettyprint << std::endl;*/
+    const cli::jobs::JobTable::JobsType& table = jobs.jobs();
+    for (cli::jobs::JobTable::JobsType::const_iterator i = table.begin();
+        i != table.end(); ++i) {
+      std::cout << '[' << i->second.id << "]  ";
+      if (arguments.arguments.size() > 1 && arguments.arguments[1] == "-l")
+        std::cout << i->second.pid() << ' ';
+      std::cout << cli::jobs::stateToString(i->second) << '\t'
+                << i->second.commandLine;
+      // Dónde se ejecuta, si se eligió al lanzarlo
+      if (! i->second.placement.empty())
+        std::cout << "\t(" << i->second.placement << ')';
+      std::cout << std::endl;
+    }
 
-    int pipeFileDes[2] = {-1, -1};
-    
-    // Variables de entorno
-    for (unsigned i = 0; i < arguments.variables.size(); ++i){
-      std::cout << "Este comando será ejecutado con la variable de entorno " << arguments.variables[i].name.c_str() << " a " <<  arguments.variables[i].value.c_str() << std::endl;
-      setenv(arguments.variables[i].name.c_str(),arguments.variables[i].value.c_str(),1);
+    // Trabajos que esperan a que haya un hueco libre
+    const cli::ShellInterpreter::QueuedJobsType& queued =
+      interpreter.queuedJobs();
+    for (cli::ShellInterpreter::QueuedJobsType::const_iterator i =
+        queued.begin(); i != queued.end(); ++i) {
+      std::cout << "[-]  Queued\t" << cli::pipelineToString(i->pipeline) << std::endl;
     }
-    
-    // Pipes
-    if (arguments.terminator == cli::ShellArguments::PIPED)
-      pipe(pipeFileDes);
-    
-    pid_t childPid = fork();
-    if (childPid == 0) {            // Proceso hijo
-      
-      // Esta variable nos dirá si el anterior proceso fue pasado por tubería
-      if (aux > 0) {
-			dup2(aux,0);	// duplicamos para poder cerrarlo después
-			close(aux);
-      }	
-      
-      // Aqui sabemos si el proceso actual debe meterse en tubería
-      if (arguments.terminator == cli::ShellArguments::PIPED) {
-			close (pipeFileDes[0]);
-			dup2(pipeFileDes[1], 1);
-			close (pipeFileDes[1]);
+
+    // Los trabajos terminados ya se han mostrado
+    jobs.takeFinished();
+    return false;
+}
+
+// Convierte en número un argumento que tiene que ser un entero no negativo.
+// A diferencia de atoi(), rechaza cosas como 'abc', '5x' o '-3'
+bool stringToCount(const std::string& value, int& count)
+{
+    const char* current = value.c_str();
+    char* end;
+    errno = 0;
+    long result = strtol(current, &end, 10);
+    if (! isdigit(static_cast<unsigned char>(*current)) || *end != '\0' ||
+        errno != 0 || result > INT_MAX)
+      return false;
+    count = result;
+    return true;
+}
+
+// jobslots [n]: muestra o cambia cuántos trabajos en segundo plano se pueden
+// ejecutar a la vez. Con 0 se vuelve a usar uno por CPU
+bool onJobSlots(cli::ShellInterpreter& interpreter,
+    const std::string& command, cli::ShellArguments const& arguments)
+{
+    if (arguments.arguments.size() < 2) {
+      std::cout << interpreter.jobSlots() << std::endl;
+      return false;
+    }
+
+    int slots;
+    if (arguments.arguments.size() > 2 ||
+        ! stringToCount(arguments.arguments[1], slots)) {
+      std::cerr << "jobslots: uso: jobslots [n]" << std::endl;
+      interpreter.lastStatus(2);
+      return false;
+    }
+    interpreter.jobSlots(slots);
+    // Si hay más huecos, los trabajos en cola pueden empezar ya
+    interpreter.runQueuedJobs();
+    return false;
+}
+
+// parsecache [-r | n]: muestra los aciertos y fallos de la caché de órdenes
+// ya analizadas, la vacía con -r o cambia cuántas puede guardar. Con 0 no se
+// usa
+bool onParseCache(cli::ShellInterpreter& interpreter,
+    const std::string& command, cli::ShellArguments const& arguments)
+{
+    cli::ShellInterpreter::ParseCacheType& cache = interpreter.parseCache();
+    if (arguments.arguments.size() < 2) {
+      std::cout << "hits: " << cache.hits()
+                << "\tmisses: " << cache.misses()
+                << "\tentries: " << cache.size() << '/' << cache.capacity()
+                << std::endl;
+      return false;
+    }
+
+    if (arguments.arguments[1] == "-r") {
+      cache.clear();
+      cache.resetStatistics();
+      return false;
+    }
+
+    int capacity;
+    if (arguments.arguments.size() > 2 ||
+        ! stringToCount(arguments.arguments[1], capacity)) {
+      std::cerr << "parsecache: uso: parsecache [-r | n]" << std::endl;
+      interpreter.lastStatus(2);
+      return false;
+    }
+    cache.capacity(capacity);
+    return false;
+}
+
+// placement [-c cpus] [-n nice] [-s política]: muestra o cambia las CPU, el
+// valor de nice y la política de planificación de los trabajos que no usan
+// 'place'. Con 'none' se vuelven a heredar del intérprete
+bool onPlacement(cli::ShellInterpreter& interpreter,
+    const std::string& command, cli::ShellArguments const& arguments)
+{
+    const std::vector<std::string>& words = arguments.arguments;
+    if (words.size() < 2) {
+      std::cout << interpreter.placement().toString() << std::endl;
+      return false;
+    }
+
+    cli::launcher::Placement placement;
+    bool isValid = true;
+    if (words.size() > 2 || words[1] != "none") {
+      for (size_t i = 1; isValid && i < words.size(); i += 2) {
+        if (i + 1 >= words.size())
+          isValid = false;
+        else if (words[i] == "-c")
+          isValid = cli::launcher::Placement::stringToCpus(words[i + 1],
+            placement.cpus);
+        else if (words[i] == "-n") {
+          isValid = cli::launcher::Placement::stringToNiceness(words[i + 1],
+            placement.niceness);
+          placement.isNicenessSet = true;
+        }
+        else if (words[i] == "-s")
+          isValid = cli::launcher::Placement::stringToPolicy(words[i + 1],
+            placement.policy);
+        else
+          isValid = false;
       }
-      // Redirecciones
-      for (unsigned i = 0; i < arguments.redirections.size(); ++i){
-            int fd = -1;
-            int mode = S_IRUSR | S_IWUSR |      // u+rw
-                       S_IRGRP | S_IWGRP |      // g+rw
-                       S_IROTH | S_IWOTH;       // o+rw
-                // Redireccion >
-  		if (arguments.redirections[i].type ==
-                	cli::StdioRedirection::TRUNCATED_OUTPUT) {
-                	fd = open(arguments.redirections[i].argument.c_str(),
-                   	 O_CREAT | O_TRUNC | O_WRONLY, mode);
-                	if (fd >= 0) {
-                   		dup2(fd, 1);    // El fd 1 se cierra antes de duplicar
-                    		close(fd);
-                	}
-            	}
-            	// Redireccion >>
-		if (arguments.redirections[i].type ==
-                	cli::StdioRedirection::APPENDED_OUTPUT) {
-                	fd = open(arguments.redirections[i].argument.c_str(),
-                   	 O_CREAT | O_APPEND | O_WRONLY, mode);
-                	if (fd >= 0) {
-                   		dup2(fd, 1);    // El fd 1 se cierra antes de duplicar
-                    		close(fd);
-                	}
-            	}
-            	// Redireccion <
-		if (arguments.redirections[i].type ==
-                	cli::StdioRedirection::INPUT) {
-                	fd = open(arguments.redirections[i].argument.c_str(),
-                   	 O_RDONLY, mode);
-                	if (fd >= 0) {
-                   		dup2(fd, 0);    // El fd 1 se cierra antes de duplicar
-                    		close(fd);
-                	}
-            	}
-		if (fd < 0) {
-                std::cerr << program_invocation_short_name
-                          << ": open: "
-                          << strerror(errno)
-                          << std::endl;
-                exit(1);
-            	}
+    }
+    if (! isValid) {
+      std::cerr << "placement: uso: placement [-c cpus] [-n nice] "
+                   "[-s other|batch|idle] | none" << std::endl;
+      interpreter.lastStatus(2);
+      return false;
+    }
+    interpreter.placement(placement);
+    return false;
+}
+
+bool onWait(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ShellArguments const& arguments)
+{
+    cli::jobs::JobTable& jobs = interpreter.jobs();
+
+    // wait -n: espera a que termine cualquier trabajo
+    if (arguments.arguments.size() == 2 && arguments.arguments[1] == "-n") {
+      interpreter.runQueuedJobs();
+      cli::jobs::Job* job = jobs.waitAny();
+      if (job != NULL) {
+        std::cerr << '[' << job->id << "] " << cli::jobs::stateToString(*job)
+                  << "\t" << job->commandLine << std::endl;
+        jobs.remove(*job);
       }
-      if (! arguments.arguments.empty()) {
-            // Ejecutar el programa indicado en la línea de comandos.
-            // Usamos execvp() para que el programa sea buscado en el PATH
-            char** argv = cli::utility::stdVectorStringToArgV(arguments.arguments);
-            execvp(argv[0], argv);
-            // Si execvp() retorna, es porque ha habido algún error.
-            // Mostramos el error y matamos el proceso para no tener múltiples
-            // shells ejectuándose a la vez.
-            std::cerr << program_invocation_short_name
-                      << ": execvp: "
-                      << strerror(errno)
-                      << std::endl;
-            exit(127);
+      return false;
+    }
+
+    // wait: espera a que terminen todos los trabajos, incluidos los que
+    // están en cola esperando un hueco
+    if (arguments.arguments.size() < 2) {
+      interpreter.runQueuedJobs(true);
+      const cli::jobs::JobTable::JobsType& table = jobs.jobs();
+      for (cli::jobs::JobTable::JobsType::const_iterator i = table.begin();
+          i != table.end(); ++i) {
+        cli::jobs::Job* job = jobs.find(i->first);
+        jobs.wait(*job);
       }
-      exit(0);
+      jobs.takeFinished();
+      return false;
     }
-    else {			    // Proceso padre
-  	// Si no se quiso lanzar en background (terminador '&') esperar a que el
-    	// proceso hijo termine
-	if (childPid > 0 ) {
-		if (arguments.terminator == cli::ShellArguments::PIPED) {
-			close(pipeFileDes[1]);
-			aux = pipeFileDes[0];
-		}
-		if (arguments.terminator == cli::ShellArguments::NORMAL) {
-			waitpid(childPid, NULL, 0);
-		}
-    	}
-    	else {
-       	 std::cerr << program_invocation_short_name
-                  << ": fork: "
-                  << strerror(errno)
+
+    for (unsigned i = 1; i < arguments.arguments.size(); ++i) {
+      cli::jobs::Job* job = findJob(interpreter, arguments, i);
+      if (job == NULL) {
+        std::cerr << "wait: " << arguments.arguments[i] << ": no such job"
                   << std::endl;
-    	}
-    	// Espera no bloqueante para recuperar la información acerca de los hijos
-    	// evitando la aparición de procesos zombi.
-    	while(waitpid(-1, NULL, WNOHANG) > 0);
-    	return false;
+        continue;
+      }
+      jobs.wait(*job);
+      if (job->state == cli::jobs::Job::DONE)
+        jobs.remove(*job);
+    }
+    return false;
+}
+
+bool onFg(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ShellArguments const& arguments)
+{
+    cli::jobs::JobTable& jobs = interpreter.jobs();
+    cli::jobs::Job* job = findJob(interpreter, arguments, 1);
+    if (job == NULL) {
+      std::cerr << "fg: no such job" << std::endl;
+      return false;
     }
+
+    std::cout << job->commandLine << std::endl;
+    int id = job->id;
+    jobs.foreground(*job, true);
+    job = jobs.find(id);
+    if (job != NULL && job->state == cli::jobs::Job::STOPPED)
+      std::cerr << std::endl << '[' << job->id << "]+  Stopped\t"
+                << job->commandLine << std::endl;
+    return false;
+}
+
+bool onBg(cli::ShellInterpreter& interpreter, const std::string& command,
+    cli::ShellArguments const& arguments)
+{
+    cli::jobs::Job* job = findJob(interpreter, arguments, 1);
+    if (job == NULL) {
+      std::cerr << "bg: no such job" << std::endl;
+      return false;
+    }
+
+    interpreter.jobs().background(*job);
+    std::cout << '[' << job->id << "]+ " << job->commandLine << " &"
+              << std::endl;
     return false;
 }
 
@@ -675,7 +823,7 @@ bool onLswc(const std::string& command,
     std::cout << noprettyprint << std::endl;
 
     int pipeFileDes[2] = {-1, -1};
-    int result = pipe(pipeFileDes);
+    int result = pipe2(pipeFileDes, O_CLOEXEC);
         if (result != 0) {
             std::cerr << program_invocation_short_name
                       << ": pipe: "
@@ -826,9 +974,6 @@ bool onMi_ls(const std::string& command,
                   << strerror(errno)
                   << std::endl;
     	}
-    	// Espera no bloqueante para recuperar la información acerca de los hijos
-    	// evitando la aparición de procesos zombi.
-    	while(waitpid(-1, NULL, WNOHANG) > 0);
     	return false;
     }
     return false;
@@ -842,6 +987,20 @@ int main(int argc, char** argv)
     // Create the shell-like interpreter
     cli::ShellInterpreter interpreter;
 
+    // Select how external programs are launched. posix_spawn() is used by
+    // default because it does not copy the address space of the shell.
+    const char* launcherName = getenv("SIMPLESHELL_LAUNCHER");
+    if (launcherName != NULL) {
+        cli::launcher::Launcher::Backend backend;
+        if (cli::launcher::Launcher::stringToBackend(launcherName, backend))
+            interpreter.launcherBackend(backend);
+        else
+            std::cerr << program_invocation_short_name
+                      << ": unknown launcher: "
+                      << launcherName
+                      << std::endl;
+    }
+
     // Set the intro and prompt texts
     interpreter.introText(INTRO_TEXT);
     interpreter.promptText(PROMPT_TEXT);
@@ -849,19 +1008,45 @@ int main(int argc, char** argv)
     // Set the callback function that will be invoked when the user inputs
     // the 'exit' command
     interpreter.onRunCommand("exit", &onExit);
-    interpreter.onRunCommand("echo", &onEcho);
-    interpreter.onRunCommand("cd", &onCd);
-    interpreter.onRunCommand("kill", &onKill);
-    interpreter.onRunCommand("test", &onTest);
     interpreter.onRunCommand("mi_ls", &onMi_ls);
     interpreter.onRunCommand("lswc", &onLswc);
 
-    // Set the callback function that will be invoked when the user inputs
-    // any other command
-    interpreter.onRunCommand(&onOtherCommand);
+    // Las órdenes internas se ejecutan en el propio proceso del intérprete,
+    // incluso si hay redirecciones o forman parte de una tubería
+    interpreter.onRunCommand("echo", &onEcho, true);
+    interpreter.onRunCommand("cd", boost::bind(&onCd,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommandView("kill", boost::bind(&onKill,
+        boost::ref(interpreter), _1, _2));
+    interpreter.onRunCommandView("test", boost::bind(&onTest,
+        boost::ref(interpreter), _1, _2));
+    interpreter.onRunCommand("hash", boost::bind(&onHash,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("jobs", boost::bind(&onJobs,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("jobslots", boost::bind(&onJobSlots,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("placement", boost::bind(&onPlacement,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("parsecache", boost::bind(&onParseCache,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("wait", boost::bind(&onWait,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("fg", boost::bind(&onFg,
+        boost::ref(interpreter), _1, _2), true);
+    interpreter.onRunCommand("bg", boost::bind(&onBg,
+        boost::ref(interpreter), _1, _2), true);
+
+    // simpleshell -c órdenes: ejecuta las órdenes indicadas y termina. Como
+    // no hay más entrada, la última orden sustituye al intérprete
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+      interpreter.interpretOneLine(argv[2], true);
+      interpreter.runQueuedJobs(true);
+      return interpreter.lastStatus();
+    }
 
     // Run the interpreter
     interpreter.loop();
 
-    return 0;
+    return interpreter.lastStatus();
 }
@@ -0,0 +1,148 @@
+/*
+ * argumentsview.cpp - Test of the builtins that get an ArgumentsView
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+
+#include <cli/argumentsview.hpp>
+#include <cli/shell.hpp>
+
+using namespace boost::placeholders;
+
+//
+// Builtins registered with onRunCommandView() get the same words as those
+// registered with onRunCommand(), whether the line is taken by the fast
+// path or by the full grammar, and the words of a repeated line reach them
+// without allocating memory.
+//
+
+namespace
+{
+    size_t allocations = 0;
+
+    std::string joinWords(cli::ArgumentsView const& arguments)
+    {
+        std::string words;
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            words += '[';
+            words.append(arguments[i]);
+            words += ']';
+        }
+        return words;
+    }
+
+    bool recordWords(std::vector<std::string>& lines, size_t& count,
+        const std::string&, cli::ArgumentsView const& arguments)
+    {
+        count = allocations;
+        lines.push_back(joinWords(arguments));
+        return false;
+    }
+
+    bool runNested(cli::ShellInterpreter& interpreter,
+        std::vector<std::string>& lines, const std::string&,
+        cli::ArgumentsView const& arguments)
+    {
+        interpreter.interpretOneLine("v inner words", false);
+        lines.push_back(joinWords(arguments));
+        return false;
+    }
+
+    std::string lookUpVariable(const std::string& name)
+    {
+        return name == "V" ? "value" : std::string();
+    }
+
+    bool check(bool condition, const std::string& message)
+    {
+        if (! condition) {
+            std::cerr << "argumentsview: " << message << std::endl;
+        }
+        return condition;
+    }
+}
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    void* memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == NULL) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+int main()
+{
+    const std::string longLine = "v /a/path/long/enough/to/be/allocated "
+        "/another/path/long/enough/to/be/allocated";
+
+    std::istringstream in;
+    std::ostringstream output;
+    std::ostringstream errors;
+    std::vector<std::string> lines;
+    size_t count = 0;
+    lines.reserve(16);
+
+    cli::ShellInterpreter interpreter(in, output, errors, false);
+    interpreter.onVariableLookup(&lookUpVariable);
+    interpreter.onRunCommandView("v", boost::bind(&recordWords,
+        boost::ref(lines), boost::ref(count), _1, _2));
+    interpreter.onRunCommandView("outer", boost::bind(&runNested,
+        boost::ref(interpreter), boost::ref(lines), _1, _2));
+
+    interpreter.interpretOneLine("v  a bb\tccc", false);
+    interpreter.interpretOneLine("v 'a b' \"$V\" c", false);
+    interpreter.interpretOneLine("outer x y", false);
+
+    // The memory of the first run is reused by the second one
+    interpreter.interpretOneLine(longLine, false);
+    size_t before = allocations;
+    interpreter.interpretOneLine(longLine, false);
+    size_t after = count;
+
+    bool isPassed = true;
+    isPassed &= check(lines.size() == 6, "wrong number of commands run");
+    isPassed &= check(lines.size() > 0 && lines[0] == "[v][a][bb][ccc]",
+        "wrong words from the fast path");
+    isPassed &= check(lines.size() > 1 && lines[1] == "[v][a b][value][c]",
+        "wrong words from the full grammar");
+    isPassed &= check(lines.size() > 3 &&
+        lines[2] == "[v][inner][words]" && lines[3] == "[outer][x][y]",
+        "the view of a command was changed by a nested one");
+    isPassed &= check(after == before,
+        "the words of a repeated line were allocated");
+    isPassed &= check(errors.str().empty(), errors.str());
+    return isPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
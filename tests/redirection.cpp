@@ -0,0 +1,121 @@
+/*
+ * redirection.cpp - Test of the expansion of redirection arguments
+ *
+ *   Copyright 2010-2013 Jesús Torres <jmtorres@ull.es>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+
+#include <stdlib.h>     // mkdtemp()
+#include <unistd.h>
+
+#include <cli/shell.hpp>
+
+using namespace boost::placeholders;
+
+//
+// Every redirection argument has to be expanded exactly once: the check
+// that it is not ambiguous uses the stored expansion.
+//
+
+namespace
+{
+    std::vector<std::string> countExpansion(std::vector<std::string>& patterns,
+        const std::string& pattern)
+    {
+        patterns.push_back(pattern);
+        return std::vector<std::string>(1, pattern);
+    }
+
+    std::string lookUpVariable(const std::string& directory,
+        const std::string& name)
+    {
+        return name == "D" ? directory : std::string();
+    }
+
+    bool doNothing(const std::string&, cli::ShellArguments const&)
+    {
+        return false;
+    }
+
+    size_t countOf(const std::vector<std::string>& patterns,
+        const std::string& pattern)
+    {
+        size_t count = 0;
+        for (std::vector<std::string>::const_iterator i = patterns.begin();
+            i < patterns.end(); ++i)
+        {
+            if (*i == pattern) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    bool check(bool condition, const std::string& message)
+    {
+        if (! condition) {
+            std::cerr << "redirection: " << message << std::endl;
+        }
+        return condition;
+    }
+}
+
+int main()
+{
+    char directory[] = "/tmp/redirectionXXXXXX";
+    if (::mkdtemp(directory) == NULL) {
+        std::cerr << "redirection: mkdtemp failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string out = std::string(directory) + "/out*";
+    const std::string err = std::string(directory) + "/err*";
+
+    std::istringstream in("x > $D/out*\n"
+                          "x > $D/out* >> $D/err*\n");
+    std::ostringstream output;
+    std::ostringstream errors;
+    std::vector<std::string> patterns;
+    {
+        cli::ShellInterpreter interpreter(in, output, errors, false);
+        interpreter.onPathnameExpansion(boost::bind(&countExpansion,
+            boost::ref(patterns), _1));
+        interpreter.onVariableLookup(boost::bind(&lookUpVariable,
+            std::string(directory), _1));
+        interpreter.onRunCommand("x", &doNothing, true);
+        interpreter.loop();
+    }
+
+    ::unlink(out.c_str());
+    ::unlink(err.c_str());
+    ::rmdir(directory);
+
+    bool isPassed = true;
+    isPassed &= check(countOf(patterns, "x") == 2,
+        "the command name was not expanded once per line");
+    isPassed &= check(countOf(patterns, out) == 2,
+        "'> $D/out*' was not expanded once per redirection");
+    isPassed &= check(countOf(patterns, err) == 1,
+        "'>> $D/err*' was not expanded once per redirection");
+    isPassed &= check(errors.str().empty(), errors.str());
+    return isPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}